@@ -0,0 +1,245 @@
+#include "clist.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Threads that can be inside list operations at the same time
+#define MAX_EPOCH_THREADS 128
+
+// Per-thread state for epoch-based reclamation, padded to its own cache line
+// so threads entering and leaving operations don't slow each other down
+typedef struct {
+    atomic_int in_use;
+    // 1 while the thread is inside a list operation
+    atomic_int active;
+    // Global epoch seen when the thread entered its current operation
+    atomic_ulong epoch;
+    char padding[64 - 2 * sizeof(atomic_int) - sizeof(atomic_ulong)];
+} epoch_slot_t;
+
+static epoch_slot_t slots[MAX_EPOCH_THREADS];
+static atomic_ulong global_epoch = 0;
+static _Thread_local int my_slot = -1;
+static pthread_key_t slot_key;
+static pthread_once_t slot_key_once = PTHREAD_ONCE_INIT;
+
+// Segments removed by clist_clear() that may still be in use by readers
+static pthread_mutex_t retired_lock = PTHREAD_MUTEX_INITIALIZER;
+static segment_t *retired = NULL;
+
+static void release_slot(void *value) {
+    atomic_store(&slots[(long) value - 1].in_use, 0);
+}
+
+static void create_slot_key(void) {
+    pthread_key_create(&slot_key, release_slot);
+}
+
+/*
+ * Get this thread's reclamation slot, claiming a free one on first use. The
+ * slot is given back when the thread exits
+ */
+static epoch_slot_t *get_slot(void) {
+    if (my_slot == -1) {
+        pthread_once(&slot_key_once, create_slot_key);
+        for (int i = 0;; i = (i + 1) % MAX_EPOCH_THREADS) {
+            int expected = 0;
+            if (atomic_compare_exchange_strong(&slots[i].in_use, &expected, 1)) {
+                my_slot = i;
+                break;
+            }
+            if (i == MAX_EPOCH_THREADS - 1) {
+                sched_yield();    // every slot is taken, wait for a thread to exit
+            }
+        }
+        pthread_setspecific(slot_key, (void *) (long) (my_slot + 1));
+    }
+    return &slots[my_slot];
+}
+
+/*
+ * Mark the start of an operation that reads list memory. Anything retired
+ * after this point stays allocated until the matching epoch_exit()
+ */
+static void epoch_enter(void) {
+    epoch_slot_t *slot = get_slot();
+    atomic_store(&slot->active, 1);
+    atomic_store(&slot->epoch, atomic_load(&global_epoch));
+}
+
+static void epoch_exit(void) {
+    atomic_store(&slots[my_slot].active, 0);
+}
+
+/*
+ * Advance the global epoch if every active thread has seen the current one,
+ * then free the retired segments no thread can still reach. A segment retired
+ * in epoch E is only reachable by threads that entered in epoch E or earlier,
+ * and the epoch can't pass E + 1 while any of them is still active
+ * Must be called with 'retired_lock' held
+ */
+static void reclaim_retired(void) {
+    unsigned long epoch = atomic_load(&global_epoch);
+    int all_current = 1;
+    for (int i = 0; i < MAX_EPOCH_THREADS && all_current; i++) {
+        if (atomic_load(&slots[i].active) && atomic_load(&slots[i].epoch) != epoch) {
+            all_current = 0;
+        }
+    }
+    if (all_current) {
+        atomic_compare_exchange_strong(&global_epoch, &epoch, epoch + 1);
+        epoch = atomic_load(&global_epoch);
+    }
+
+    segment_t **link = &retired;
+    while (*link != NULL) {
+        segment_t *segment = *link;
+        if (segment->retire_epoch + 2 <= epoch) {
+            *link = segment->next_retired;
+            cnode_t *node = atomic_load(&segment->head.next);
+            while (node != NULL) {
+                cnode_t *next = atomic_load(&node->next);
+                free(node);
+                node = next;
+            }
+            free(segment);
+        } else {
+            link = &segment->next_retired;
+        }
+    }
+}
+
+static segment_t *new_segment(void) {
+    segment_t *segment = malloc(sizeof(segment_t));
+    if (segment == NULL) {
+        return NULL;
+    }
+    segment->head.data[0] = '\0';
+    atomic_init(&segment->head.next, NULL);
+    atomic_init(&segment->tail, &segment->head);
+    atomic_init(&segment->size, 0);
+    segment->next_retired = NULL;
+    return segment;
+}
+
+int clist_init(clist_t *list) {
+    segment_t *segment = new_segment();
+    if (segment == NULL) {
+        return -1;
+    }
+    atomic_init(&list->current, segment);
+    return 0;
+}
+
+void clist_add(clist_t *list, const char *data) {
+    cnode_t *node = malloc(sizeof(cnode_t));
+    if (node == NULL) {
+        return;
+    }
+    strncpy(node->data, data, MAX_LEN - 1);
+    node->data[MAX_LEN - 1] = '\0';
+    atomic_init(&node->next, NULL);
+
+    epoch_enter();
+    segment_t *segment = atomic_load(&list->current);
+    // Counting the node before it takes a position keeps every reachable
+    // node within the first 'size' nodes, which bounds reader traversals
+    atomic_fetch_add(&segment->size, 1);
+    // Taking the tail orders this node after every earlier append; linking
+    // it to its predecessor is a single store that nothing else contends for
+    cnode_t *prev = atomic_exchange(&segment->tail, node);
+    atomic_store_explicit(&prev->next, node, memory_order_release);
+    epoch_exit();
+}
+
+int clist_size(clist_t *list) {
+    epoch_enter();
+    int size = atomic_load(&atomic_load(&list->current)->size);
+    epoch_exit();
+    return size;
+}
+
+char *clist_get(clist_t *list, int index, char *buf) {
+    if (index < 0) {
+        return NULL;
+    }
+    epoch_enter();
+    segment_t *segment = atomic_load(&list->current);
+    cnode_t *node = atomic_load_explicit(&segment->head.next, memory_order_acquire);
+    for (int i = 0; node != NULL && i < index; i++) {
+        node = atomic_load_explicit(&node->next, memory_order_acquire);
+    }
+    if (node != NULL) {
+        memcpy(buf, node->data, MAX_LEN);
+    }
+    epoch_exit();
+    return node != NULL ? buf : NULL;
+}
+
+/*
+ * Queue 'segment', just removed from its list, to be freed once no reader can
+ * still be using it
+ */
+static void retire_segment(segment_t *segment) {
+    pthread_mutex_lock(&retired_lock);
+    segment->retire_epoch = atomic_load(&global_epoch);
+    segment->next_retired = retired;
+    retired = segment;
+    reclaim_retired();
+    pthread_mutex_unlock(&retired_lock);
+}
+
+int clist_clear(clist_t *list) {
+    segment_t *segment = new_segment();
+    if (segment == NULL) {
+        return -1;
+    }
+    retire_segment(atomic_exchange(&list->current, segment));
+    return 0;
+}
+
+int clist_contains(clist_t *list, const char *query) {
+    int found = 0;
+    epoch_enter();
+    segment_t *segment = atomic_load(&list->current);
+    // Appends that start after the size is read are not searched, which
+    // keeps the number of steps bounded however fast other threads add
+    int size = atomic_load(&segment->size);
+    cnode_t *node = atomic_load_explicit(&segment->head.next, memory_order_acquire);
+    for (int i = 0; node != NULL && i < size && !found; i++) {
+        found = strcmp(node->data, query) == 0;
+        node = atomic_load_explicit(&node->next, memory_order_acquire);
+    }
+    epoch_exit();
+    return found;
+}
+
+void clist_print(clist_t *list) {
+    epoch_enter();
+    segment_t *segment = atomic_load(&list->current);
+    int size = atomic_load(&segment->size);
+    cnode_t *node = atomic_load_explicit(&segment->head.next, memory_order_acquire);
+    for (int i = 0; node != NULL && i < size; i++) {
+        printf("%d: %s\n", i, node->data);
+        node = atomic_load_explicit(&node->next, memory_order_acquire);
+    }
+    epoch_exit();
+}
+
+void clist_destroy(clist_t *list) {
+    retire_segment(atomic_exchange(&list->current, NULL));
+    // Wait out readers of every retired segment, possibly from other lists
+    pthread_mutex_lock(&retired_lock);
+    while (retired != NULL) {
+        reclaim_retired();
+        if (retired != NULL) {
+            pthread_mutex_unlock(&retired_lock);
+            sched_yield();
+            pthread_mutex_lock(&retired_lock);
+        }
+    }
+    pthread_mutex_unlock(&retired_lock);
+}
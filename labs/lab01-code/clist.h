@@ -0,0 +1,70 @@
+/* Concurrent List Functions */
+
+#ifndef CLIST_H
+#define CLIST_H
+
+#include <stdatomic.h>
+
+#include "list.h"
+
+typedef struct cnode_struct {
+    char data[MAX_LEN];
+    _Atomic(struct cnode_struct *) next;
+} cnode_t;
+
+// One generation of a list's contents. clist_clear() swaps in an empty
+// segment and frees the old one only once no thread can still be reading it
+typedef struct segment_struct {
+    // Sentinel node; the first item is head.next
+    cnode_t head;
+    // Last node linked or being linked; appends swap themselves in here
+    _Atomic(cnode_t *) tail;
+    // Appends started on the segment, counted before they take the tail
+    atomic_int size;
+    // Position in the list of segments waiting to be freed
+    struct segment_struct *next_retired;
+    unsigned long retire_epoch;
+} segment_t;
+
+// A list of strings that any number of threads may use at once, with no
+// locks on the add and read paths:
+//  - clist_add() claims the tail with one atomic exchange, then links its
+//    node after the previous tail. Until that link is stored, the node and
+//    any appended after it are not yet visible to readers
+//  - clist_size(), clist_get(), clist_contains() and clist_print() are
+//    wait-free: they never wait for another thread and visit at most as many
+//    nodes as the list held when they started
+//  - clist_clear() is safe to call while other threads read or add; the old
+//    contents are freed by epoch-based reclamation after every reader that
+//    might still see them has finished
+typedef struct {
+    _Atomic(segment_t *) current;
+} clist_t;
+
+// Initialize an empty list. Returns 0 on success and -1 if memory runs out
+int clist_init(clist_t *list);
+
+// Add a new string to the tail of the list
+void clist_add(clist_t *list, const char *data);
+
+// Returns how many items are in the list, including appends in progress
+int clist_size(clist_t *list);
+
+// Copy the item at the specified index into 'buf', which must hold MAX_LEN
+// characters. Returns 'buf', or NULL if the index is out of bounds.
+char *clist_get(clist_t *list, int index, char *buf);
+
+// Remove all items from the list. Returns 0 on success and -1 if memory runs
+// out, in which case the list is unchanged
+int clist_clear(clist_t *list);
+
+// Returns 1 if the list contains the given query and 0 otherwise.
+int clist_contains(clist_t *list, const char *query);
+
+// Print out all items in the list
+void clist_print(clist_t *list);
+
+// Free all memory used by the list. No other thread may be using it
+void clist_destroy(clist_t *list);
+
+#endif
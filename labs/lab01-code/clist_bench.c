@@ -0,0 +1,118 @@
+// Benchmark comparing list_t behind a global mutex with the concurrent list
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "clist.h"
+#include "list.h"
+
+// Items in the list before the timed operations start
+#define PRELOAD_ITEMS 1000
+
+// Which list the worker threads use
+typedef enum { LIST_MUTEX, LIST_CONCURRENT } list_kind_t;
+
+static list_t locked_list;
+static pthread_mutex_t list_lock = PTHREAD_MUTEX_INITIALIZER;
+static clist_t concurrent_list;
+
+typedef struct {
+    list_kind_t kind;
+    int num_ops;
+    // Percentage of operations that add an item; the rest are lookups
+    int add_percent;
+    unsigned int seed;
+} worker_args_t;
+
+static void *worker(void *arg) {
+    worker_args_t *args = arg;
+    char item[MAX_LEN];
+    for (int i = 0; i < args->num_ops; i++) {
+        int add = (int) (rand_r(&args->seed) % 100) < args->add_percent;
+        snprintf(item, sizeof(item), "item%d", rand_r(&args->seed) % PRELOAD_ITEMS);
+        if (args->kind == LIST_CONCURRENT) {
+            if (add) {
+                clist_add(&concurrent_list, item);
+            } else {
+                clist_contains(&concurrent_list, item);
+            }
+        } else {
+            pthread_mutex_lock(&list_lock);
+            if (add) {
+                list_add(&locked_list, item);
+            } else {
+                list_contains(&locked_list, item);
+            }
+            pthread_mutex_unlock(&list_lock);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Time 'num_threads' threads doing 'num_ops' operations each on a freshly
+ * preloaded list of the given kind
+ * Returns the throughput in operations per second
+ */
+static double run(list_kind_t kind, int num_threads, int num_ops, int add_percent) {
+    char item[MAX_LEN];
+    list_init(&locked_list);
+    clist_init(&concurrent_list);
+    for (int i = 0; i < PRELOAD_ITEMS; i++) {
+        snprintf(item, sizeof(item), "item%d", i);
+        list_add(&locked_list, item);
+        clist_add(&concurrent_list, item);
+    }
+
+    pthread_t threads[num_threads];
+    worker_args_t args[num_threads];
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < num_threads; i++) {
+        args[i] = (worker_args_t){kind, num_ops, add_percent, i + 1};
+        pthread_create(&threads[i], NULL, worker, &args[i]);
+    }
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    list_clear(&locked_list);
+    clist_destroy(&concurrent_list);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    return (double) num_threads * num_ops / seconds;
+}
+
+int main(int argc, char *argv[]) {
+    int max_threads = 8;
+    int num_ops = 20000;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:n:")) != -1) {
+        if (opt == 't' && atoi(optarg) > 0) {
+            max_threads = atoi(optarg);
+        } else if (opt == 'n' && atoi(optarg) > 0) {
+            num_ops = atoi(optarg);
+        } else {
+            printf("Usage: %s [-t MAX_THREADS] [-n OPS_PER_THREAD]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("%d operations per thread on a list preloaded with %d items\n", num_ops,
+           PRELOAD_ITEMS);
+    int add_percents[] = {100, 10};
+    for (int i = 0; i < 2; i++) {
+        printf("\n%d%% adds, %d%% lookups\n", add_percents[i], 100 - add_percents[i]);
+        printf("%8s %16s %16s %8s\n", "threads", "mutex ops/s", "clist ops/s", "speedup");
+        for (int threads = 1; threads <= max_threads; threads *= 2) {
+            double locked = run(LIST_MUTEX, threads, num_ops, add_percents[i]);
+            double concurrent = run(LIST_CONCURRENT, threads, num_ops, add_percents[i]);
+            printf("%8d %16.0f %16.0f %7.2fx\n", threads, locked, concurrent,
+                   concurrent / locked);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,182 @@
+// Multi-threaded stress test for the concurrent list
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "clist.h"
+
+#define NUM_WRITERS 8
+#define NUM_READERS 4
+#define ITEMS_PER_WRITER 20000
+
+static clist_t list;
+static atomic_int writers_done;
+static atomic_int failed;
+
+/*
+ * Record a failed check, printing the first few
+ */
+static void fail(const char *message, const char *item) {
+    if (atomic_fetch_add(&failed, 1) < 5) {
+        printf("FAILED: %s: '%s'\n", message, item);
+    }
+}
+
+/*
+ * Checks that 'item' is one a writer could have added: "w<writer>-<number>"
+ */
+static int valid_item(const char *item) {
+    int writer;
+    int number;
+    char extra;
+    return sscanf(item, "w%d-%d%c", &writer, &number, &extra) == 2 && writer >= 0 &&
+           writer < NUM_WRITERS && number >= 0 && number < ITEMS_PER_WRITER;
+}
+
+static void *writer(void *arg) {
+    long id = (long) arg;
+    char item[MAX_LEN];
+    for (int i = 0; i < ITEMS_PER_WRITER; i++) {
+        snprintf(item, sizeof(item), "w%ld-%d", id, i);
+        clist_add(&list, item);
+    }
+    atomic_fetch_add(&writers_done, 1);
+    return NULL;
+}
+
+/*
+ * Reads the list while it changes, checking that sizes never shrink (unless
+ * clears are running) and that every item read back is intact
+ */
+static void *reader(void *arg) {
+    int clearing = (long) arg;
+    unsigned int seed = (unsigned int) (long) &seed;
+    char buf[MAX_LEN];
+    int last_size = 0;
+    while (atomic_load(&writers_done) < NUM_WRITERS) {
+        int size = clist_size(&list);
+        if (!clearing && size < last_size) {
+            fail("size went down", "");
+        }
+        last_size = size;
+        if (size > 0) {
+            // Only the first few thousand items, so a scan stays short
+            int index = rand_r(&seed) % (size < 4096 ? size : 4096);
+            if (clist_get(&list, index, buf) != NULL && !valid_item(buf)) {
+                fail("corrupt item", buf);
+            }
+            snprintf(buf, sizeof(buf), "w%d-%d", rand_r(&seed) % NUM_WRITERS, rand_r(&seed) % 64);
+            clist_contains(&list, buf);
+        }
+    }
+    return NULL;
+}
+
+static void *clearer(void *arg) {
+    struct timespec pause = {0, 100000};
+    while (atomic_load(&writers_done) < NUM_WRITERS) {
+        if (clist_clear(&list) != 0) {
+            fail("clear ran out of memory", "");
+        }
+        nanosleep(&pause, NULL);
+    }
+    return NULL;
+}
+
+/*
+ * Walks the finished list, checking that its size matches its nodes and, if
+ * 'complete', that it holds every item with each writer's items in order
+ */
+static void check_contents(int complete) {
+    segment_t *segment = atomic_load(&list.current);
+    int next_number[NUM_WRITERS] = {0};
+    int count = 0;
+    for (cnode_t *node = atomic_load(&segment->head.next); node != NULL;
+         node = atomic_load(&node->next)) {
+        int writer;
+        int number;
+        count++;
+        if (!valid_item(node->data)) {
+            fail("corrupt item", node->data);
+            continue;
+        }
+        sscanf(node->data, "w%d-%d", &writer, &number);
+        if (number < next_number[writer]) {
+            fail("item out of order", node->data);
+        }
+        next_number[writer] = number + 1;
+    }
+    if (count != atomic_load(&segment->size)) {
+        fail("size doesn't match the items", "");
+    }
+    if (complete && count != NUM_WRITERS * ITEMS_PER_WRITER) {
+        fail("items are missing", "");
+    }
+}
+
+/*
+ * Runs the writers and readers together, plus a thread clearing the list
+ * every 0.1 ms if 'clearing' is set
+ * Returns 0 if every check passed and -1 otherwise
+ */
+static int run_phase(const char *name, int clearing) {
+    pthread_t writers[NUM_WRITERS];
+    pthread_t readers[NUM_READERS];
+    pthread_t clear_thread;
+    atomic_store(&writers_done, 0);
+    atomic_store(&failed, 0);
+    clist_init(&list);
+
+    for (long i = 0; i < NUM_READERS; i++) {
+        pthread_create(&readers[i], NULL, reader, (void *) (long) clearing);
+    }
+    if (clearing) {
+        pthread_create(&clear_thread, NULL, clearer, NULL);
+    }
+    for (long i = 0; i < NUM_WRITERS; i++) {
+        pthread_create(&writers[i], NULL, writer, (void *) i);
+    }
+    for (int i = 0; i < NUM_WRITERS; i++) {
+        pthread_join(writers[i], NULL);
+    }
+    for (int i = 0; i < NUM_READERS; i++) {
+        pthread_join(readers[i], NULL);
+    }
+    if (clearing) {
+        pthread_join(clear_thread, NULL);
+    }
+
+    check_contents(!clearing);
+    clist_destroy(&list);
+    printf("%s: %d writers x %d items, %d readers%s: %s\n", name, NUM_WRITERS,
+           ITEMS_PER_WRITER, NUM_READERS, clearing ? ", 1 clearer" : "",
+           atomic_load(&failed) == 0 ? "ok" : "FAILED");
+    return atomic_load(&failed) == 0 ? 0 : -1;
+}
+
+int main(void) {
+    // The single-threaded behavior matches list_t
+    char buf[MAX_LEN];
+    clist_init(&list);
+    clist_add(&list, "apple");
+    clist_add(&list, "pear");
+    clist_add(&list, "banana");
+    clist_print(&list);
+    printf("size: %d\n", clist_size(&list));
+    printf("get 1: %s\n", clist_get(&list, 1, buf) != NULL ? buf : "Out of bounds");
+    printf("get 3: %s\n", clist_get(&list, 3, buf) != NULL ? buf : "Out of bounds");
+    printf("contains pear: %d, contains kiwi: %d\n", clist_contains(&list, "pear"),
+           clist_contains(&list, "kiwi"));
+    clist_clear(&list);
+    printf("after clear: size %d\n", clist_size(&list));
+    clist_destroy(&list);
+
+    int result = run_phase("append", 0);
+    if (run_phase("append and clear", 1) != 0) {
+        result = -1;
+    }
+    return result == 0 ? 0 : 1;
+}
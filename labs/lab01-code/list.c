@@ -5,91 +5,156 @@
 #include <string.h>
 
 void list_init(list_t *list) {
-    list->head = NULL;
+    list->chunks = NULL;
+    list->num_chunks = 0;
+    list->chunk_capacity = 0;
     list->size = 0;
+    list->sorted = 0;
+    list->index = NULL;
 }
 
-void list_add(list_t *list, const char *data) {
-    node_t *node = malloc(sizeof(node_t));
-
-    if(node == NULL){
-        return;
-    }
-
-    strcpy(node->data,data);
-    node->data[MAX_LEN-1]= '\0';
-    node->next = NULL;
-
-    if(list -> head == NULL){
-        list->head = node;
-    }else{
-        node_t *curr_node = list->head;
+void list_init_sorted(list_t *list) {
+    list_init(list);
+    list->sorted = 1;
+}
 
-        while(curr_node->next != NULL){
-            curr_node = curr_node ->next;
+void list_add(list_t *list, const char *data) {
+    // Start a new chunk when the last one is full, doubling the array of
+    // chunk pointers when needed so appends stay O(1) amortized
+    if (list->size == list->num_chunks * CHUNK_ITEMS) {
+        if (list->num_chunks == list->chunk_capacity) {
+            int capacity = list->chunk_capacity > 0 ? 2 * list->chunk_capacity : 4;
+            chunk_t **chunks = realloc(list->chunks, capacity * sizeof(chunk_t *));
+            if (chunks == NULL) {
+                return;
+            }
+            list->chunks = chunks;
+            list->chunk_capacity = capacity;
         }
-
-        curr_node -> next = node;
+        chunk_t *chunk = malloc(sizeof(chunk_t));
+        if (chunk == NULL) {
+            return;
+        }
+        list->chunks[list->num_chunks++] = chunk;
+    }
+    if (list->sorted && list->index == NULL) {
+        // Without an index list_contains() falls back to a linear scan
+        list->index = calloc(1, sizeof(sorted_index_t));
     }
 
+    char *item = list->chunks[list->size / CHUNK_ITEMS]->data[list->size % CHUNK_ITEMS];
+    strncpy(item, data, MAX_LEN - 1);
+    item[MAX_LEN - 1] = '\0';
     list->size++;
-    // TODO
 }
 
 int list_size(const list_t *list) {
-    // TODO
     return list->size;
 }
 
 char *list_get(const list_t *list, int index) {
-    // TODO
-    int count = 0;
-    node_t *current = list->head;
-    while(current != NULL){
-        if(count == index){
-            return current->data;
-        }
+    if (index < 0 || index >= list->size) {
+        return NULL;
+    }
+    return list->chunks[index / CHUNK_ITEMS]->data[index % CHUNK_ITEMS];
+}
 
-        current = current->next;
-        count ++;
+void list_clear(list_t *list) {
+    for (int i = 0; i < list->num_chunks; i++) {
+        free(list->chunks[i]);
+    }
+    free(list->chunks);
+    if (list->index != NULL) {
+        free(list->index->items);
+        free(list->index);
     }
 
-    return NULL;
+    int sorted = list->sorted;
+    list_init(list);
+    list->sorted = sorted;
 }
 
-void list_clear(list_t *list) {
-    node_t *current = list->head;
+static int compare_items(const void *a, const void *b) {
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
 
-    while(current != NULL){
-        node_t *next_node = current -> next;
-        free(current);
-        current= next_node;
+static int compare_query(const void *query, const void *item) {
+    return strcmp(query, *(char *const *) item);
+}
+
+/*
+ * Bring the sorted index up to date with all of the list's items. Items added
+ * since the last update are sorted on their own and then merged with the
+ * already sorted ones. Returns 0 on success and -1 if memory runs out
+ */
+static int update_index(const list_t *list) {
+    sorted_index_t *index = list->index;
+    if (index->count == list->size) {
+        return 0;
+    }
+    if (index->capacity < list->size) {
+        int capacity = index->capacity > 0 ? index->capacity : 64;
+        while (capacity < list->size) {
+            capacity *= 2;
+        }
+        char **items = realloc(index->items, capacity * sizeof(char *));
+        if (items == NULL) {
+            return -1;
+        }
+        index->items = items;
+        index->capacity = capacity;
     }
 
-    list->size = 0;
-    list->head = NULL;
-    // TODO
+    int old_count = index->count;
+    for (int i = old_count; i < list->size; i++) {
+        index->items[i] = list_get(list, i);
+    }
+    qsort(index->items + old_count, list->size - old_count, sizeof(char *), compare_items);
+
+    if (old_count > 0) {
+        char **old_items = malloc(old_count * sizeof(char *));
+        if (old_items == NULL) {
+            qsort(index->items, list->size, sizeof(char *), compare_items);
+        } else {
+            // Merging in place front to back is safe: the next slot written
+            // never passes the next new item still to be read
+            memcpy(old_items, index->items, old_count * sizeof(char *));
+            int i = 0;
+            int j = old_count;
+            int out = 0;
+            while (i < old_count && j < list->size) {
+                if (strcmp(old_items[i], index->items[j]) <= 0) {
+                    index->items[out++] = old_items[i++];
+                } else {
+                    index->items[out++] = index->items[j++];
+                }
+            }
+            while (i < old_count) {
+                index->items[out++] = old_items[i++];
+            }
+            free(old_items);
+        }
+    }
+    index->count = list->size;
+    return 0;
 }
 
 int list_contains(const list_t *list, const char *query) {
-    // TODO
-    node_t *current = list->head;
+    if (list->index != NULL && update_index(list) == 0) {
+        return bsearch(query, list->index->items, list->index->count, sizeof(char *),
+                       compare_query) != NULL;
+    }
 
-    while(current != NULL){
-        if(strcmp(current->data,query) == 0 ){
+    for (int i = 0; i < list->size; i++) {
+        if (strcmp(list_get(list, i), query) == 0) {
             return 1;
         }
-        current = current ->next;
     }
     return 0;
 }
 
 void list_print(const list_t *list) {
-    int i = 0;
-    node_t *current = list->head;
-    while (current != NULL) {
-        printf("%d: %s\n", i, current->data);
-        current = current->next;
-        i++;
+    for (int i = 0; i < list->size; i++) {
+        printf("%d: %s\n", i, list_get(list, i));
     }
 }
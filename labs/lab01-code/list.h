@@ -3,20 +3,43 @@
 #ifndef LIST_H
 #define LIST_H
 #define MAX_LEN 128
+// Items are stored in fixed-size chunks that never move once allocated, so
+// pointers returned by list_get() stay valid until the list is cleared
+#define CHUNK_ITEMS 256
 
-typedef struct node_struct {
-    char data[MAX_LEN];
-    struct node_struct *next;
-} node_t;
+typedef struct {
+    char data[CHUNK_ITEMS][MAX_LEN];
+} chunk_t;
+
+// Pointers to list items in strcmp() order, used by sorted lists
+typedef struct {
+    char **items;
+    // Only the first 'count' items of the list are indexed; newer items are
+    // merged in the next time the index is searched
+    int count;
+    int capacity;
+} sorted_index_t;
 
 typedef struct {
-    node_t *head;
+    // Item i is chunks[i / CHUNK_ITEMS]->data[i % CHUNK_ITEMS]
+    chunk_t **chunks;
+    int num_chunks;
+    int chunk_capacity;
     int size;
+    // 1 if the list was initialized with list_init_sorted()
+    int sorted;
+    // Allocated by list_add() for sorted lists, updated by list_contains()
+    sorted_index_t *index;
 } list_t;
 
 // Initialize memory for an empty linked list
 void list_init(list_t *list);
 
+// Initialize an empty list in sorted mode: items keep their insertion order,
+// but list_contains() uses binary search over a sorted index of the items
+// that is brought up to date lazily
+void list_init_sorted(list_t *list);
+
 // Add a new string to the tail of the list
 void list_add(list_t *list, const char *data);
 
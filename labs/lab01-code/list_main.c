@@ -1,10 +1,153 @@
 // Function for a linked list command-line program
+#include <ctype.h>
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "list.h"
 
+// Batch mode reads its input and buffers its output this much at a time
+#define BATCH_BUF_SIZE (1 << 20)
+
+// Splits input read in large blocks into whitespace-separated tokens
+typedef struct {
+    int fd;
+    // BATCH_BUF_SIZE bytes of input plus room to terminate the last token
+    char *data;
+    size_t start;    // first byte not yet tokenized
+    size_t len;      // bytes of input in 'data'
+    int eof;
+} token_reader_t;
+
+/*
+ * Get the next token, terminated in place inside the input buffer. The token
+ * is only valid until the next call, which may move unread input around
+ * Returns NULL at the end of the input
+ */
+static char *next_token(token_reader_t *reader) {
+    char *data = reader->data;
+    while (1) {
+        size_t start = reader->start;
+        while (start < reader->len && isspace((unsigned char) data[start])) {
+            start++;
+        }
+        size_t end = start;
+        while (end < reader->len && !isspace((unsigned char) data[end])) {
+            end++;
+        }
+        // A token is complete once whitespace follows it, or the input ends
+        // after it, or it fills the whole buffer
+        int full = start == 0 && end == BATCH_BUF_SIZE;
+        if (end < reader->len || ((reader->eof || full) && end > start)) {
+            data[end] = '\0';
+            reader->start = end < reader->len ? end + 1 : end;
+            return data + start;
+        }
+        if (reader->eof) {
+            return NULL;
+        }
+
+        // Keep the partial token and fill the rest of the buffer after it
+        memmove(data, data + start, end - start);
+        reader->len = end - start;
+        reader->start = 0;
+        ssize_t bytes_read = read(reader->fd, data + reader->len, BATCH_BUF_SIZE - reader->len);
+        if (bytes_read == -1 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_read <= 0) {
+            if (bytes_read == -1) {
+                perror("Error reading commands");
+            }
+            reader->eof = 1;
+        } else {
+            reader->len += bytes_read;
+        }
+    }
+}
+
+/*
+ * Run the commands read from 'fd' without prompts, for scripts and pipelines.
+ * Input is tokenized in place and all output goes through a large stdout
+ * buffer, so the cost is dominated by the list operations themselves
+ * Returns 0 on success and -1 on error
+ */
+static int run_batch(list_t *list, int fd) {
+    token_reader_t reader = {fd, malloc(BATCH_BUF_SIZE + 1), 0, 0, 0};
+    if (reader.data == NULL) {
+        perror("Error allocating input buffer");
+        return -1;
+    }
+    setvbuf(stdout, NULL, _IOFBF, BATCH_BUF_SIZE);
+
+    char *cmd;
+    while ((cmd = next_token(&reader)) != NULL && strcmp("exit", cmd) != 0) {
+        if (strcmp("insert", cmd) == 0) {
+            char *item = next_token(&reader);
+            if (item != NULL) {
+                list_add(list, item);
+            }
+        } else if (strcmp("size", cmd) == 0) {
+            printf("%d\n", list_size(list));
+        } else if (strcmp("get", cmd) == 0) {
+            char *arg = next_token(&reader);
+            int index = arg != NULL ? atoi(arg) : -1;
+            char *ith = list_get(list, index);
+            if (ith == NULL) {
+                printf("Out of bounds\n");
+            } else {
+                printf("%d: %s\n", index, ith);
+            }
+        } else if (strcmp("clear", cmd) == 0) {
+            list_clear(list);
+        } else if (strcmp("print", cmd) == 0) {
+            list_print(list);
+        } else if (strcmp("contains", cmd) == 0) {
+            char *query = next_token(&reader);
+            if (query != NULL && list_contains(list, query)) {
+                printf("\'%s\' is present\n", query);
+            } else {
+                printf("Not found\n");
+            }
+        } else {
+            printf("Unknown command %s\n", cmd);
+        }
+    }
+
+    free(reader.data);
+    return fflush(stdout) == 0 ? 0 : -1;
+}
+
 int main(int argc, char *argv[]) {
+    // -s keeps a sorted index so 'contains' can use binary search, and -b
+    // runs commands from stdin in batch mode
+    int sorted = 0;
+    int batch = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0) {
+            sorted = 1;
+        } else if (strcmp(argv[i], "-b") == 0) {
+            batch = 1;
+        } else {
+            printf("Usage: %s [-s] [-b]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    list_t list;
+    if (sorted) {
+        list_init_sorted(&list);
+    } else {
+        list_init(&list);
+    }
+    if (batch) {
+        int result = run_batch(&list, STDIN_FILENO);
+        list_clear(&list);
+        return result == 0 ? 0 : 1;
+    }
+
     printf("Linked List Demo\n");
     printf("Commands:\n");
     printf("  print:          shows the current contents of the list\n");
@@ -16,9 +159,7 @@ int main(int argc, char *argv[]) {
     printf("  contains thing: determine if the given thing is in the list\n");
 
     char cmd[128];
-    list_t list;
     int success;
-    list_init(&list);
 
     while (1) {
         printf("list> ");                      // print prompt
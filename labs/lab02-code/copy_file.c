@@ -1,61 +1,333 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define BUF_SIZE 4096
+// Most bytes moved by one copy_file_range() or sendfile() call
+#define MAX_CHUNK (1 << 30)
+// Files are split across threads only if every thread gets at least this much
+#define MIN_RANGE_SIZE (8 * 1024 * 1024)
+#define MAX_THREADS 64
+
+// Ways of copying a file, fastest first
+typedef enum {
+    // Share the source's blocks with the copy on a copy-on-write file system
+    TIER_REFLINK,
+    // copy_file_range() on several threads, each copying its own part of the file
+    TIER_PARALLEL,
+    // Copy inside the kernel, or offload the copy to the file system
+    TIER_COPY_FILE_RANGE,
+    // Copy inside the kernel through the page cache
+    TIER_SENDFILE,
+    // Copy through a buffer in this process
+    TIER_READ_WRITE
+} copy_tier_t;
+
+static const char *tier_names[] = {"reflink", "copy_file_range (parallel)", "copy_file_range",
+                                   "sendfile", "read/write"};
+
+// Part of a file copied by one thread
+typedef struct {
+    int src_fd;
+    int dest_fd;
+    off_t offset;
+    size_t len;
+    int error;    // errno value if the copy failed, 0 otherwise
+} copy_range_t;
 
 /*
- * Copy the contents of one file into another file
+ * Copy 'len' bytes at 'offset' in 'src_fd' to the same offset in 'dest_fd',
+ * inside the kernel where possible
+ * Returns 0 on success and -1 on error, with errno set
+ */
+static int copy_range(int src_fd, int dest_fd, off_t offset, size_t len) {
+    off_t src_offset = offset;
+    off_t dest_offset = offset;
+    while (len > 0) {
+        size_t chunk = len < MAX_CHUNK ? len : MAX_CHUNK;
+        ssize_t copied = copy_file_range(src_fd, &src_offset, dest_fd, &dest_offset, chunk, 0);
+        if (copied == -1 && errno == EINTR) {
+            continue;
+        }
+        if (copied == -1 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS ||
+                             errno == EOPNOTSUPP)) {
+            break;    // finish with pread()/pwrite() below
+        }
+        if (copied <= 0) {
+            if (copied == 0) {
+                errno = EIO;    // source is shorter than it was
+            }
+            return -1;
+        }
+        len -= copied;
+    }
+
+    char buffer[BUF_SIZE];
+    while (len > 0) {
+        size_t chunk = len < BUF_SIZE ? len : BUF_SIZE;
+        ssize_t bytes_read = pread(src_fd, buffer, chunk, src_offset);
+        if (bytes_read == -1 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_read <= 0) {
+            if (bytes_read == 0) {
+                errno = EIO;
+            }
+            return -1;
+        }
+        for (ssize_t done = 0; done < bytes_read;) {
+            ssize_t written = pwrite(dest_fd, buffer + done, bytes_read - done, src_offset + done);
+            if (written == -1 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                if (written == 0) {
+                    errno = EIO;    // nothing written, so no errno of its own
+                }
+                return -1;
+            }
+            done += written;
+        }
+        src_offset += bytes_read;
+        len -= bytes_read;
+    }
+    return 0;
+}
+
+/*
+ * Thread start routine: copies one range of the file
+ */
+static void *copy_range_worker(void *arg) {
+    copy_range_t *range = arg;
+    if (copy_range(range->src_fd, range->dest_fd, range->offset, range->len) != 0) {
+        range->error = errno != 0 ? errno : EIO;    // 0 would read as success
+    }
+    return NULL;
+}
+
+/*
+ * Copy the first 'size' bytes of 'src_fd' to 'dest_fd' as 'num_threads' ranges
+ * copied at the same time
+ * Returns 0 on success and -1 on error
+ */
+static int copy_parallel(int src_fd, int dest_fd, size_t size, int num_threads) {
+    // Setting the size up front lets every thread write its range in place
+    if (ftruncate(dest_fd, size) != 0) {
+        perror("Error sizing destination file");
+        return -1;
+    }
+
+    copy_range_t ranges[MAX_THREADS];
+    pthread_t threads[MAX_THREADS];
+    int started[MAX_THREADS];
+    size_t range_size = size / num_threads;
+    for (int i = 0; i < num_threads; i++) {
+        ranges[i].src_fd = src_fd;
+        ranges[i].dest_fd = dest_fd;
+        ranges[i].offset = i * range_size;
+        ranges[i].len = i == num_threads - 1 ? size - i * range_size : range_size;
+        ranges[i].error = 0;
+        started[i] = pthread_create(&threads[i], NULL, copy_range_worker, &ranges[i]) == 0;
+        if (!started[i]) {
+            // Copy whatever couldn't be handed to a thread on this one
+            copy_range_worker(&ranges[i]);
+        }
+    }
+    for (int i = 0; i < num_threads; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    for (int i = 0; i < num_threads; i++) {
+        if (ranges[i].error != 0) {
+            errno = ranges[i].error;
+            perror("Error copying file");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Copy everything left in 'src_fd' to 'dest_fd' with one of the kernel copy
+ * calls, starting at the fastest tier that works for these files. '*tier' is
+ * set to the tier used
+ * Returns 0 on success, 1 if neither call supports these files and nothing
+ * was copied, and -1 on error
+ */
+static int copy_in_kernel(int src_fd, int dest_fd, copy_tier_t *tier) {
+    int copied_any = 0;
+    *tier = TIER_COPY_FILE_RANGE;
+    while (1) {
+        ssize_t copied;
+        if (*tier == TIER_COPY_FILE_RANGE) {
+            copied = copy_file_range(src_fd, NULL, dest_fd, NULL, MAX_CHUNK, 0);
+        } else {
+            copied = sendfile(dest_fd, src_fd, NULL, MAX_CHUNK);
+        }
+        if (copied == 0) {
+            return 0;
+        }
+        if (copied > 0) {
+            copied_any = 1;
+            continue;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        // e.g. files on different file systems on older kernels, or a source
+        // that isn't a regular file
+        int unsupported = errno == EXDEV || errno == EINVAL || errno == ENOSYS ||
+                          errno == EOPNOTSUPP;
+        if (!unsupported || copied_any) {
+            perror("Error copying file");
+            return -1;
+        }
+        if (*tier == TIER_SENDFILE) {
+            return 1;
+        }
+        *tier = TIER_SENDFILE;
+    }
+}
+
+/*
+ * Copy the rest of 'src_fd' to 'dest_fd' through a buffer
+ * Returns 0 on success and -1 on error
+ */
+static int copy_read_write(int src_fd, int dest_fd) {
+    char buffer[BUF_SIZE];
+    ssize_t bytes_read;
+    while ((bytes_read = read(src_fd, buffer, sizeof(buffer))) != 0) {
+        if (bytes_read == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Error reading source file");
+            return -1;
+        }
+        for (ssize_t done = 0; done < bytes_read;) {
+            ssize_t written = write(dest_fd, buffer + done, bytes_read - done);
+            if (written == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                perror("Error writing to destination file");
+                return -1;
+            }
+            done += written;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Copy the contents of one file into another file, using the fastest method
+ * the two files support
  *   source_file: Name of the source file to copy from
  *   dest_file: Name of the destination file to copy to
+ *   num_threads: Number of threads to split the copy of a large regular file
+ *       across, 1 to copy it in one piece
+ *   tier: Set to the method used
  * The destination file is overwritten if it already exists
  * Returns 0 on success and -1 on error
  */
-int copy_file(const char *source_file, const char *dest_file) {
-    FILE* fp = fopen(source_file, "rb");
-    if(fp == NULL) {
+int copy_file_tiered(const char *source_file, const char *dest_file, int num_threads,
+                     copy_tier_t *tier) {
+    int src_fd = open(source_file, O_RDONLY);
+    if (src_fd == -1) {
         perror("Error opening source file");
-        return -1;  // Changed from 1 to -1
+        return -1;
+    }
+    struct stat stat_buf;
+    if (fstat(src_fd, &stat_buf) != 0) {
+        perror("Error opening source file");
+        close(src_fd);
+        return -1;
     }
 
-    FILE* dest_fp = fopen(dest_file, "wb");
-    if(dest_fp == NULL){
+    int dest_fd = open(dest_file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (dest_fd == -1) {
         perror("Error opening destination file");
-        fclose(fp);
-        return -1;  // Changed from 1 to -1
+        close(src_fd);
+        return -1;
     }
 
-    char buffer[BUF_SIZE];  // Use the defined constant
-    size_t bytes_read;
-
-    while((bytes_read = fread(buffer, 1, sizeof(buffer), fp)) > 0){
-        if(fwrite(buffer, 1, bytes_read, dest_fp) != bytes_read){
-            perror("Error writing to destination file");
-            fclose(fp);
-            fclose(dest_fp);
-            return -1;  // Changed from 1 to -1
+    int result;
+    size_t size = stat_buf.st_size;
+    if (num_threads > MAX_THREADS) {
+        num_threads = MAX_THREADS;
+    }
+    if (S_ISREG(stat_buf.st_mode) && ioctl(dest_fd, FICLONE, src_fd) == 0) {
+        *tier = TIER_REFLINK;
+        result = 0;
+    } else if (S_ISREG(stat_buf.st_mode) && num_threads > 1 &&
+               size / num_threads >= MIN_RANGE_SIZE) {
+        *tier = TIER_PARALLEL;
+        result = copy_parallel(src_fd, dest_fd, size, num_threads);
+    } else {
+        result = copy_in_kernel(src_fd, dest_fd, tier);
+        if (result == 1) {
+            *tier = TIER_READ_WRITE;
+            result = copy_read_write(src_fd, dest_fd);
         }
     }
 
-    if(ferror(fp)){
-        perror("Error reading source file");
-        fclose(fp);
-        fclose(dest_fp);
-        return -1;  // Changed from 1 to -1
+    close(src_fd);
+    if (close(dest_fd) != 0 && result == 0) {
+        perror("Error writing to destination file");
+        result = -1;
     }
+    return result;
+}
 
-    fclose(fp);
-    fclose(dest_fp);
-    return 0;
+/*
+ * Copy the contents of one file into another file
+ *   source_file: Name of the source file to copy from
+ *   dest_file: Name of the destination file to copy to
+ * The destination file is overwritten if it already exists
+ * Returns 0 on success and -1 on error
+ */
+int copy_file(const char *source_file, const char *dest_file) {
+    copy_tier_t tier;
+    return copy_file_tiered(source_file, dest_file, 1, &tier);
 }
 
 int main(int argc, char **argv) {
-    if (argc < 3) {
-        printf("Usage: %s <source> <dest>\n", argv[0]);
+    int verbose = 0;
+    int num_threads = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "vj:")) != -1) {
+        if (opt == 'v') {
+            verbose = 1;
+        } else if (opt == 'j' && atoi(optarg) > 0) {
+            num_threads = atoi(optarg);
+        } else {
+            optind = argc;    // falls through to the usage message
+            break;
+        }
+    }
+    if (argc - optind < 2) {
+        printf("Usage: %s [-v] [-j THREADS] <source> <dest>\n", argv[0]);
         return 1;
     }
 
-    // copy_file already prints out any errors
-    if (copy_file(argv[1], argv[2]) != 0) {
+    // copy_file_tiered already prints out any errors
+    copy_tier_t tier;
+    if (copy_file_tiered(argv[optind], argv[optind + 1], num_threads, &tier) != 0) {
         return 1;
     }
+    if (verbose) {
+        fprintf(stderr, "Copied with %s\n", tier_names[tier]);
+    }
     return 0;
 }
@@ -1,5 +1,38 @@
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <libgen.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Text is collected here and handed to write() only when it fills up
+#define OUT_BUF_SIZE (1 << 20)
+// Longest line one integer can produce: "-9223372036854775808\n"
+#define MAX_INT_TEXT 21
+// Appended data is read this much at a time in follow mode, a multiple of
+// every supported integer width
+#define IN_BUF_SIZE (1 << 16)
+
+// Layout of the integers in a binary file
+typedef struct {
+    int width;         // bytes per integer: 1, 2, 4 or 8
+    int big_endian;    // 1 if the most significant byte comes first
+} int_format_t;
+
+static char out_buf[OUT_BUF_SIZE];
+static size_t out_len = 0;
+
+// "00" "01" ... "99", so two digits can be converted per division
+static const char digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
 
 /*
  * Read the last integers from a binary file
@@ -58,16 +91,407 @@ int read_last_ints(const char *file_name, int num_ints) {
     return 0;
 }
 
+/*
+ * Write all buffered output to stdout
+ * Returns 0 on success and -1 on error
+ */
+static int flush_output(void) {
+    size_t done = 0;
+    while (done < out_len) {
+        ssize_t written = write(STDOUT_FILENO, out_buf + done, out_len - done);
+        if (written == -1) {
+            perror("Error writing output");
+            return -1;
+        }
+        done += written;
+    }
+    out_len = 0;
+    return 0;
+}
+
+/*
+ * Append 'value' and a newline to the output buffer. The buffer must have
+ * room for MAX_INT_TEXT more characters
+ */
+static void append_int(int64_t value) {
+    char digits[MAX_INT_TEXT];
+    char *pos = digits + sizeof(digits);
+    // Negating as unsigned also works for INT64_MIN
+    uint64_t magnitude = value < 0 ? -(uint64_t) value : (uint64_t) value;
+    while (magnitude >= 100) {
+        const char *pair = &digit_pairs[(magnitude % 100) * 2];
+        magnitude /= 100;
+        *--pos = pair[1];
+        *--pos = pair[0];
+    }
+    if (magnitude >= 10) {
+        *--pos = digit_pairs[magnitude * 2 + 1];
+        *--pos = digit_pairs[magnitude * 2];
+    } else {
+        *--pos = '0' + magnitude;
+    }
+    if (value < 0) {
+        *--pos = '-';
+    }
+
+    size_t len = digits + sizeof(digits) - pos;
+    memcpy(out_buf + out_len, pos, len);
+    out_len += len;
+    out_buf[out_len++] = '\n';
+}
+
+/*
+ * Decode the signed integer stored at 'record' in the given format
+ */
+static int64_t decode_int(const unsigned char *record, const int_format_t *format) {
+    switch (format->width) {
+        case 1:
+            return (int8_t) record[0];
+        case 2: {
+            uint16_t bits;
+            memcpy(&bits, record, sizeof(bits));
+            return (int16_t) (format->big_endian ? be16toh(bits) : le16toh(bits));
+        }
+        case 4: {
+            uint32_t bits;
+            memcpy(&bits, record, sizeof(bits));
+            return (int32_t) (format->big_endian ? be32toh(bits) : le32toh(bits));
+        }
+        default: {
+            uint64_t bits;
+            memcpy(&bits, record, sizeof(bits));
+            return (int64_t) (format->big_endian ? be64toh(bits) : le64toh(bits));
+        }
+    }
+}
+
+/*
+ * Print the integers in the 'len' bytes at 'records', one per line, through
+ * the output buffer
+ * Returns 0 on success and -1 on error
+ */
+static int print_records(const unsigned char *records, size_t len, const int_format_t *format) {
+    for (size_t pos = 0; pos + format->width <= len; pos += format->width) {
+        if (OUT_BUF_SIZE - out_len < MAX_INT_TEXT && flush_output() != 0) {
+            return -1;
+        }
+        append_int(decode_int(records + pos, format));
+    }
+    return 0;
+}
+
+/*
+ * Read the last integers from a binary file by mapping just the end of the
+ * file into memory
+ *   'file_name': The name of the file to read from
+ *   'num_ints': The number of integers to read
+ *   'format': Width and byte order of the integers in the file
+ *   'end_offset': Set to the end of the last whole record when the file was read
+ * Output is converted into a large buffer and written out with few write()
+ * calls, which matters when printing millions of integers
+ * Returns 0 on success and -1 on error
+ */
+int read_last_ints_mapped(const char *file_name, long num_ints, const int_format_t *format,
+                          off_t *end_offset) {
+    int fd = open(file_name, O_RDONLY);
+    if (fd == -1) {
+        perror("Error opening file");
+        return -1;
+    }
+    struct stat stat_buf;
+    if (fstat(fd, &stat_buf) != 0) {
+        perror("Error getting file size");
+        close(fd);
+        return -1;
+    }
+    // A writer may be partway through the last record; leave it for later
+    off_t records_end = stat_buf.st_size - stat_buf.st_size % format->width;
+    *end_offset = records_end;
+
+    long total_ints = records_end / format->width;
+    if (num_ints > total_ints) {
+        printf("File only contains %ld integers, cannot read %ld\n", total_ints, num_ints);
+        close(fd);
+        return -1;
+    }
+    if (num_ints <= 0) {
+        close(fd);
+        return 0;
+    }
+
+    // The mapping has to start on a page boundary at or before the tail
+    off_t tail_start = records_end - num_ints * format->width;
+    off_t map_start = tail_start & ~((off_t) sysconf(_SC_PAGESIZE) - 1);
+    size_t map_len = records_end - map_start;
+    unsigned char *map = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fd, map_start);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("Error mapping file");
+        return -1;
+    }
+    madvise(map, map_len, MADV_SEQUENTIAL);
+
+    int result = print_records(map + (tail_start - map_start), num_ints * format->width, format);
+    munmap(map, map_len);
+    if (flush_output() != 0) {
+        result = -1;
+    }
+    return result;
+}
+
+// A file being followed as it grows
+typedef struct {
+    const char *file_name;
+    int fd;            // -1 while no file exists under 'file_name'
+    dev_t dev;         // identity of the open file, to notice rotation
+    ino_t ino;
+    off_t offset;      // start of the first record not printed yet
+    int inotify_fd;
+    int file_wd;       // watch on the open file
+} follow_t;
+
+/*
+ * Open the file named by 'follow' and start watching it for changes
+ * Returns 0 on success, 1 if no such file exists right now, and -1 on error
+ */
+static int open_followed(follow_t *follow) {
+    int fd = open(follow->file_name, O_RDONLY);
+    if (fd == -1) {
+        if (errno == ENOENT) {
+            return 1;
+        }
+        perror("Error opening file");
+        return -1;
+    }
+    struct stat stat_buf;
+    if (fstat(fd, &stat_buf) != 0) {
+        perror("Error getting file size");
+        close(fd);
+        return -1;
+    }
+    // Watching the descriptor's path after opening it means any write that
+    // the watch misses happened before the next read, so is still seen
+    int wd = inotify_add_watch(follow->inotify_fd, follow->file_name,
+                               IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+    if (wd == -1) {
+        perror("Error watching file");
+        close(fd);
+        return -1;
+    }
+    follow->fd = fd;
+    follow->dev = stat_buf.st_dev;
+    follow->ino = stat_buf.st_ino;
+    follow->file_wd = wd;
+    return 0;
+}
+
+/*
+ * Print every whole record appended to the followed file since the last call.
+ * A partial record at the end is left until the rest of it is written. If the
+ * file shrank below what was already printed, it is read again from the start
+ * Returns 0 on success and -1 on error
+ */
+static int read_appended(follow_t *follow, const int_format_t *format) {
+    static unsigned char in_buf[IN_BUF_SIZE];
+    int size_changed = 1;
+    while (size_changed) {
+        struct stat stat_buf;
+        if (fstat(follow->fd, &stat_buf) != 0) {
+            perror("Error getting file size");
+            return -1;
+        }
+        if (stat_buf.st_size < follow->offset) {
+            fprintf(stderr, "%s: file truncated\n", follow->file_name);
+            follow->offset = 0;
+        }
+
+        size_changed = 0;
+        off_t available = (stat_buf.st_size - follow->offset) / format->width * format->width;
+        while (available > 0) {
+            size_t chunk = available < IN_BUF_SIZE ? available : IN_BUF_SIZE;
+            ssize_t bytes_read = pread(follow->fd, in_buf, chunk, follow->offset);
+            if (bytes_read == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                perror("Error reading file");
+                return -1;
+            }
+            bytes_read -= bytes_read % format->width;
+            if (bytes_read == 0) {
+                // Truncated since fstat(), so check the size again
+                size_changed = 1;
+                break;
+            }
+            if (print_records(in_buf, bytes_read, format) != 0) {
+                return -1;
+            }
+            follow->offset += bytes_read;
+            available -= bytes_read;
+        }
+    }
+    return flush_output();
+}
+
+/*
+ * Switch to a new file if the followed name now refers to one, e.g. after log
+ * rotation renamed or deleted the old file and created a new one. Whatever
+ * was appended to the old file before the switch is printed first
+ * Returns 0 on success and -1 on error
+ */
+static int check_rotation(follow_t *follow, const int_format_t *format) {
+    struct stat stat_buf;
+    if (stat(follow->file_name, &stat_buf) != 0) {
+        if (errno == ENOENT) {
+            return 0;    // wait for the file to be created again
+        }
+        perror("Error checking file");
+        return -1;
+    }
+    if (follow->fd != -1 && stat_buf.st_dev == follow->dev && stat_buf.st_ino == follow->ino) {
+        return 0;
+    }
+
+    if (follow->fd != -1) {
+        if (read_appended(follow, format) != 0) {
+            return -1;
+        }
+        fprintf(stderr, "%s: file replaced, following new file\n", follow->file_name);
+        // The old watch may already be gone if the old file was deleted
+        inotify_rm_watch(follow->inotify_fd, follow->file_wd);
+        close(follow->fd);
+        follow->fd = -1;
+    }
+    int result = open_followed(follow);
+    if (result != 0) {
+        return result == 1 ? 0 : -1;
+    }
+    follow->offset = 0;
+    return read_appended(follow, format);
+}
+
+/*
+ * Print integers as they are appended to a binary file, without polling
+ *   'file_name': The name of the file to follow
+ *   'offset': Where in the file the first new record starts
+ *   'format': Width and byte order of the integers in the file
+ * Blocks on inotify until the file changes, then reads only the whole records
+ * appended since the last read. A file that shrinks is read again from the
+ * start, and if the name is moved or deleted, the file created in its place
+ * is followed from its start. Only returns on error
+ * Returns -1 on error
+ */
+int follow_ints(const char *file_name, off_t offset, const int_format_t *format) {
+    follow_t follow = {file_name, -1, 0, 0, offset, -1, -1};
+    follow.inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (follow.inotify_fd == -1) {
+        perror("Error starting inotify");
+        return -1;
+    }
+
+    // The directory is watched to see the file reappear after rotation
+    char dir_buf[strlen(file_name) + 1];
+    char name_buf[strlen(file_name) + 1];
+    const char *dir_name = dirname(strcpy(dir_buf, file_name));
+    const char *base_name = basename(strcpy(name_buf, file_name));
+    int dir_wd = inotify_add_watch(follow.inotify_fd, dir_name, IN_CREATE | IN_MOVED_TO);
+    if (dir_wd == -1) {
+        perror("Error watching directory");
+        close(follow.inotify_fd);
+        return -1;
+    }
+
+    int result = open_followed(&follow);
+    if (result == 0) {
+        result = read_appended(&follow, format);
+    } else if (result == 1) {
+        result = 0;
+    }
+
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (result == 0) {
+        ssize_t len = read(follow.inotify_fd, events, sizeof(events));
+        if (len == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Error waiting for changes");
+            result = -1;
+            break;
+        }
+
+        int file_changed = 0;
+        int maybe_rotated = 0;
+        for (char *pos = events; pos < events + len;) {
+            struct inotify_event *event = (struct inotify_event *) pos;
+            pos += sizeof(struct inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                file_changed = maybe_rotated = 1;
+            } else if (event->wd == dir_wd) {
+                maybe_rotated |= !strcmp(event->name, base_name);
+            } else if (event->wd == follow.file_wd) {
+                file_changed |= (event->mask & IN_MODIFY) != 0;
+                maybe_rotated |= (event->mask & IN_MODIFY) == 0;
+            }
+        }
+        if (file_changed && follow.fd != -1) {
+            result = read_appended(&follow, format);
+        }
+        if (maybe_rotated && result == 0) {
+            result = check_rotation(&follow, format);
+        }
+    }
+
+    if (follow.fd != -1) {
+        close(follow.fd);
+    }
+    close(follow.inotify_fd);
+    return result;
+}
+
 int main(int argc, char **argv) {
-    if (argc < 3) {
-        printf("Usage: %s <file_name> <num_ints>\n", argv[0]);
+    int mapped = 0;
+    int follow = 0;
+    int_format_t format = {sizeof(int), __BYTE_ORDER == __BIG_ENDIAN};
+    int opt;
+    while ((opt = getopt(argc, argv, "fmw:e:")) != -1) {
+        if (opt == 'f') {
+            follow = 1;
+        } else if (opt == 'm') {
+            mapped = 1;
+        } else if (opt == 'w' && (!strcmp(optarg, "1") || !strcmp(optarg, "2") ||
+                                  !strcmp(optarg, "4") || !strcmp(optarg, "8"))) {
+            format.width = atoi(optarg);
+            mapped = 1;
+        } else if (opt == 'e' && (!strcmp(optarg, "little") || !strcmp(optarg, "big"))) {
+            format.big_endian = !strcmp(optarg, "big");
+            mapped = 1;
+        } else {
+            optind = argc;    // falls through to the usage message
+            break;
+        }
+    }
+    if (argc - optind < 2) {
+        printf("Usage: %s [-f] [-m] [-w 1|2|4|8] [-e little|big] <file_name> <num_ints>\n",
+               argv[0]);
         return 1;
     }
 
-    const char *file_name = argv[1];
-    int num_ints = atoi(argv[2]);
-    if (read_last_ints(file_name, num_ints) != 0) {
-        printf("Failed to read last %d ints from file %s\n", num_ints, file_name);
+    const char *file_name = argv[optind];
+    long num_ints = atol(argv[optind + 1]);
+    off_t end_offset;
+    int result;
+    // Follow mode needs to know where the printed records ended
+    if (mapped || follow) {
+        result = read_last_ints_mapped(file_name, num_ints, &format, &end_offset);
+    } else {
+        result = read_last_ints(file_name, num_ints);
+    }
+    if (result != 0) {
+        printf("Failed to read last %ld ints from file %s\n", num_ints, file_name);
+        return 1;
+    }
+    if (follow && follow_ints(file_name, end_offset, &format) != 0) {
         return 1;
     }
     return 0;
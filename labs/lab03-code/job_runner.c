@@ -0,0 +1,243 @@
+// Runs command lines as child processes, keeping several running at once
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/signalfd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_JOBS 1024
+
+extern char **environ;
+
+// A child process that is still running
+typedef struct {
+    pid_t pid;    // 0 if the slot is free
+    int number;
+    char *command;
+    struct timespec start;
+} job_t;
+
+static job_t jobs[MAX_JOBS];
+static int max_running = 1;
+static int num_running = 0;
+static int num_failed = 0;
+// Signal mask to restore in children, since SIGCHLD is blocked in the parent
+static sigset_t child_mask;
+// Start jobs with posix_spawn() instead of fork() and exec, which doesn't
+// copy the parent's page tables and stays fast however large the parent is
+static int use_spawn = 0;
+static posix_spawnattr_t spawn_attr;
+static posix_spawn_file_actions_t spawn_actions;
+
+static double seconds_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * Start 'command' with /bin/sh as job number 'number' in a free slot. Its
+ * stdin is /dev/null, so it can't swallow commands still to be read from ours
+ * Returns 0 on success and -1 if the child couldn't be created, with errno set
+ */
+static int start_job(char *command, int number) {
+    job_t *job = jobs;
+    while (job->pid != 0) {
+        job++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &job->start);
+    pid_t pid;
+    if (use_spawn) {
+        char *argv[] = {"sh", "-c", command, NULL};
+        errno = posix_spawn(&pid, "/bin/sh", &spawn_actions, &spawn_attr, argv, environ);
+        if (errno != 0) {
+            return -1;
+        }
+    } else if ((pid = fork()) < 0) {
+        return -1;
+    } else if (pid == 0) {
+        sigprocmask(SIG_SETMASK, &child_mask, NULL);
+        int null_fd = open("/dev/null", O_RDONLY);
+        if (null_fd == -1 || dup2(null_fd, STDIN_FILENO) == -1) {
+            perror("Failed to redirect stdin");
+            _exit(127);
+        }
+        close(null_fd);
+        execl("/bin/sh", "sh", "-c", command, (char *) NULL);
+        perror("exec failed");
+        _exit(127);
+    }
+    job->pid = pid;
+    job->number = number;
+    job->command = command;
+    num_running++;
+    return 0;
+}
+
+/*
+ * Collect every child that has finished, without blocking, and report its
+ * exit status and wall time on stderr
+ */
+static void reap_jobs(void) {
+    while (1) {
+        siginfo_t info;
+        info.si_pid = 0;
+        if (waitid(P_ALL, 0, &info, WEXITED | WNOHANG) != 0 || info.si_pid == 0) {
+            return;
+        }
+        job_t *job = jobs;
+        while (job < jobs + max_running && job->pid != info.si_pid) {
+            job++;
+        }
+        if (job == jobs + max_running) {
+            continue;    // not one of ours
+        }
+
+        double elapsed = seconds_since(&job->start);
+        if (info.si_code == CLD_EXITED) {
+            fprintf(stderr, "job %d: exit %d, %.3fs: %s\n", job->number, info.si_status, elapsed,
+                    job->command);
+            num_failed += info.si_status != 0;
+        } else {
+            fprintf(stderr, "job %d: killed by signal %d (%s), %.3fs: %s\n", job->number,
+                    info.si_status, strsignal(info.si_status), elapsed, job->command);
+            num_failed++;
+        }
+        free(job->command);
+        job->pid = 0;
+        num_running--;
+    }
+}
+
+/*
+ * Block until at least one child exits, then reap every child that has
+ * Returns 0 on success and -1 on error
+ */
+static int wait_for_jobs(int signal_fd) {
+    struct signalfd_siginfo signal_info;
+    // SIGCHLDs that arrive together are merged, so reaping handles any number
+    // of children per signal
+    while (read(signal_fd, &signal_info, sizeof(signal_info)) == -1) {
+        if (errno != EINTR) {
+            perror("read() from signalfd failed");
+            return -1;
+        }
+    }
+    reap_jobs();
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "j:p")) != -1) {
+        if (opt == 'j' && atoi(optarg) > 0 && atoi(optarg) <= MAX_JOBS) {
+            max_running = atoi(optarg);
+        } else if (opt == 'p') {
+            use_spawn = 1;
+        } else {
+            optind = argc + 1;    // falls through to the usage message
+            break;
+        }
+    }
+    if (optind < argc - 1 || optind > argc) {
+        printf("Usage: %s [-j JOBS] [-p] [FILE]\n", argv[0]);
+        printf("Runs each line of FILE, or of stdin, as a shell command, with up to JOBS "
+               "at once\n-p starts commands with posix_spawn() instead of fork()\n");
+        return 1;
+    }
+    FILE *input = stdin;
+    if (optind == argc - 1) {
+        input = fopen(argv[optind], "re");
+        if (input == NULL) {
+            perror("Failed to open command file");
+            return 1;
+        }
+    }
+
+    // SIGCHLD is delivered through a file descriptor instead of a handler,
+    // and it must be blocked before the first child can exit
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, &child_mask) != 0) {
+        perror("sigprocmask() failed");
+        return 1;
+    }
+    int signal_fd = signalfd(-1, &mask, SFD_CLOEXEC);
+    if (signal_fd == -1) {
+        perror("signalfd() failed");
+        return 1;
+    }
+    if (use_spawn) {
+        posix_spawnattr_init(&spawn_attr);
+        posix_spawnattr_setsigmask(&spawn_attr, &child_mask);
+        posix_spawnattr_setflags(&spawn_attr, POSIX_SPAWN_SETSIGMASK);
+        posix_spawn_file_actions_init(&spawn_actions);
+        posix_spawn_file_actions_addopen(&spawn_actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int num_jobs = 0;
+    int result = 0;
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t len;
+    while (result == 0 && (len = getline(&line, &line_size, input)) != -1) {
+        if (len > 0 && line[len - 1] == '\n') {
+            line[len - 1] = '\0';
+        }
+        if (line[strspn(line, " \t")] == '\0' || line[strspn(line, " \t")] == '#') {
+            continue;    // blank line or comment
+        }
+        // A signal may be left over from a child that was already reaped, so
+        // one wakeup doesn't guarantee a free slot
+        while (result == 0 && num_running == max_running) {
+            result = wait_for_jobs(signal_fd);
+        }
+        char *command = result == 0 ? strdup(line) : NULL;
+        if (command == NULL) {
+            result = -1;
+            break;
+        }
+        num_jobs++;
+        // Out of processes for now: wait for a running job to make room
+        while (start_job(command, num_jobs) != 0) {
+            if (errno != EAGAIN || num_running == 0) {
+                perror(use_spawn ? "posix_spawn() failed" : "fork() failed");
+                free(command);
+                result = -1;
+                break;
+            }
+            if (wait_for_jobs(signal_fd) != 0) {
+                free(command);
+                result = -1;
+                break;
+            }
+        }
+    }
+    free(line);
+    if (input != stdin) {
+        fclose(input);
+    }
+
+    // Let the jobs already started finish even if starting another failed
+    while (num_running > 0 && wait_for_jobs(signal_fd) == 0) {
+    }
+    close(signal_fd);
+    if (use_spawn) {
+        posix_spawnattr_destroy(&spawn_attr);
+        posix_spawn_file_actions_destroy(&spawn_actions);
+    }
+    fprintf(stderr, "%d jobs, %d failed, %.3fs\n", num_jobs, num_failed, seconds_since(&start));
+    return result == 0 && num_failed == 0 ? 0 : 1;
+}
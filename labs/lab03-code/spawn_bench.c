@@ -0,0 +1,264 @@
+// Benchmark of the ways to start a child process, as the parent grows
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern char **environ;
+
+// Histogram buckets are powers of two in microseconds: bucket i counts
+// latencies in [2^i, 2^(i+1)) us, the first one everything faster and the
+// last one everything slower
+#define NUM_BUCKETS 24
+#define BAR_WIDTH 40
+// Stack for the clone() child, which only needs enough room to call exec
+#define CLONE_STACK_SIZE (64 * 1024)
+
+typedef enum { SPAWN_FORK, SPAWN_VFORK, SPAWN_POSIX_SPAWN, SPAWN_CLONE, NUM_METHODS } method_t;
+
+static const char *method_names[NUM_METHODS] = {"fork+exec", "vfork", "posix_spawn",
+                                                "clone(VM|VFORK)"};
+
+static char *child_argv[] = {"/bin/true", NULL};
+static char clone_stack[CLONE_STACK_SIZE] __attribute__((aligned(16)));
+
+// Timings of every spawn of one method at one parent size
+typedef struct {
+    double *latencies;    // microseconds, spawn to reaped exit
+    int count;
+    double total_seconds;
+} samples_t;
+
+static int exec_child(void *arg) {
+    (void) arg;
+    execv(child_argv[0], child_argv);
+    _exit(127);
+}
+
+/*
+ * Start /bin/true with the given method
+ * Returns the child's pid, or -1 on error with errno set
+ */
+static pid_t spawn(method_t method) {
+    pid_t pid;
+    switch (method) {
+    case SPAWN_FORK:
+        pid = fork();
+        if (pid == 0) {
+            exec_child(NULL);
+        }
+        return pid;
+    case SPAWN_VFORK:
+        // The child borrows the parent's memory and stack until it execs,
+        // so it may do nothing but exec or _exit
+        pid = vfork();
+        if (pid == 0) {
+            execv(child_argv[0], child_argv);
+            _exit(127);
+        }
+        return pid;
+    case SPAWN_POSIX_SPAWN:
+        errno = posix_spawn(&pid, child_argv[0], NULL, NULL, child_argv, environ);
+        return errno == 0 ? pid : -1;
+    case SPAWN_CLONE:
+        // Same sharing as vfork(), but the child runs on its own stack
+        return clone(exec_child, clone_stack + CLONE_STACK_SIZE, CLONE_VM | CLONE_VFORK | SIGCHLD,
+                     NULL);
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+static double seconds_between(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * Spawn and reap 'iterations' children one at a time, recording each one's
+ * latency into 'samples'
+ * Returns 0 on success and -1 on error
+ */
+static int run(method_t method, int iterations, samples_t *samples) {
+    struct timespec run_start;
+    struct timespec start;
+    struct timespec end;
+    samples->count = 0;
+    clock_gettime(CLOCK_MONOTONIC, &run_start);
+    for (int i = 0; i < iterations; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        pid_t pid = spawn(method);
+        if (pid == -1) {
+            perror(method_names[method]);
+            return -1;
+        }
+        int status;
+        if (waitpid(pid, &status, 0) == -1) {
+            perror("waitpid() failed");
+            return -1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "%s: %s did not run\n", method_names[method], child_argv[0]);
+            return -1;
+        }
+        samples->latencies[samples->count++] = seconds_between(&start, &end) * 1e6;
+    }
+    samples->total_seconds = seconds_between(&run_start, &end);
+    return 0;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Print one row of the summary table; sorts the samples
+ */
+static void print_summary(method_t method, samples_t *samples) {
+    qsort(samples->latencies, samples->count, sizeof(double), compare_doubles);
+    double *sorted = samples->latencies;
+    printf("  %-16s %10.0f %10.1f %10.1f %10.1f %10.1f\n", method_names[method],
+           samples->count / samples->total_seconds, sorted[samples->count / 2],
+           sorted[samples->count * 99 / 100], sorted[samples->count - 1], sorted[0]);
+}
+
+static void print_histogram(method_t method, const samples_t *samples) {
+    int counts[NUM_BUCKETS] = {0};
+    int first = NUM_BUCKETS;
+    int last = 0;
+    int most = 0;
+    for (int i = 0; i < samples->count; i++) {
+        int bucket = 0;
+        while (bucket < NUM_BUCKETS - 1 && samples->latencies[i] >= (double) (2L << bucket)) {
+            bucket++;
+        }
+        counts[bucket]++;
+        first = bucket < first ? bucket : first;
+        last = bucket > last ? bucket : last;
+        most = counts[bucket] > most ? counts[bucket] : most;
+    }
+    printf("  %s\n", method_names[method]);
+    for (int bucket = first; bucket <= last; bucket++) {
+        char bar[BAR_WIDTH + 1];
+        int width = (counts[bucket] * BAR_WIDTH + most - 1) / most;
+        memset(bar, '#', width);
+        bar[width] = '\0';
+        printf("    %8ld - %8ld us %6d %s\n", bucket == 0 ? 0 : 1L << bucket, (2L << bucket) - 1,
+               counts[bucket], bar);
+    }
+}
+
+/*
+ * Grow the parent by 'megabytes' of touched anonymous memory, which is what
+ * fork() has to copy page tables for
+ * Returns the mapping, or NULL on error
+ */
+static char *grow_parent(long megabytes) {
+    size_t size = (size_t) megabytes << 20;
+    char *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        perror("mmap() failed");
+        return NULL;
+    }
+    long page_size = sysconf(_SC_PAGESIZE);
+    for (size_t offset = 0; offset < size; offset += page_size) {
+        memory[offset] = 1;
+    }
+    return memory;
+}
+
+static long resident_megabytes(void) {
+    long size;
+    long pages = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm != NULL) {
+        if (fscanf(statm, "%ld %ld", &size, &pages) != 2) {
+            pages = 0;
+        }
+        fclose(statm);
+    }
+    return pages * sysconf(_SC_PAGESIZE) >> 20;
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = 200;
+    int show_histograms = 1;
+    char *sizes = "16,256,1024,2048";
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:q")) != -1) {
+        if (opt == 'n' && atoi(optarg) > 0) {
+            iterations = atoi(optarg);
+        } else if (opt == 's') {
+            sizes = optarg;
+        } else if (opt == 'q') {
+            show_histograms = 0;
+        } else {
+            printf("Usage: %s [-n SPAWNS] [-s MB,MB,...] [-q]\n", argv[0]);
+            printf("Times SPAWNS runs of /bin/true with each spawn method, with the parent grown "
+                   "to each size in MB\n-q leaves out the latency histograms\n");
+            return 1;
+        }
+    }
+
+    samples_t samples[NUM_METHODS];
+    for (int m = 0; m < NUM_METHODS; m++) {
+        samples[m].latencies = malloc(iterations * sizeof(double));
+        if (samples[m].latencies == NULL) {
+            perror("malloc() failed");
+            return 1;
+        }
+    }
+
+    int result = 0;
+    char *size_list = strdup(sizes);
+    if (size_list == NULL) {
+        perror("strdup() failed");
+        return 1;
+    }
+    char *save = NULL;
+    for (char *token = strtok_r(size_list, ",", &save); token != NULL && result == 0;
+         token = strtok_r(NULL, ",", &save)) {
+        long megabytes = atol(token);
+        char *memory = megabytes > 0 ? grow_parent(megabytes) : NULL;
+        if (megabytes > 0 && memory == NULL) {
+            result = -1;
+            break;
+        }
+
+        printf("parent RSS %ld MB, %d spawns each\n", resident_megabytes(), iterations);
+        printf("  %-16s %10s %10s %10s %10s %10s\n", "method", "spawns/s", "p50 us", "p99 us",
+               "max us", "min us");
+        for (int m = 0; m < NUM_METHODS && result == 0; m++) {
+            result = run(m, iterations, &samples[m]);
+            if (result == 0) {
+                print_summary(m, &samples[m]);
+            }
+        }
+        for (int m = 0; m < NUM_METHODS && result == 0 && show_histograms; m++) {
+            print_histogram(m, &samples[m]);
+        }
+        printf("\n");
+        if (memory != NULL) {
+            munmap(memory, (size_t) megabytes << 20);
+        }
+    }
+
+    free(size_list);
+    for (int m = 0; m < NUM_METHODS; m++) {
+        free(samples[m].latencies);
+    }
+    return result == 0 ? 0 : 1;
+}
@@ -1,72 +1,351 @@
-// redirect_child.c: starts a child process which will print into a
-// file instead of onto the screen. Uses dup2(), fork(), and wait()
+// redirect_child.c: starts a pipeline of child processes which will print
+// into a file instead of onto the screen, or into both at once. Uses pipe(),
+// dup2(), fork(), splice(), tee(), and waitpid()
+#define _GNU_SOURCE
+
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
-int main(int argc, char *argv[]) {
-    if (argc < 2) {    // check for at least 1 command line arg
-        printf("Usage: %s <childfile>\n", argv[0]);
-        return 1;
-    }
+#define MAX_STAGES 64
+// Capacity asked for on every pipe. Bigger pipes let a fast stage run
+// further ahead of a slow one before it blocks, and let each splice() move
+// more at once. Unprivileged processes are capped at
+// /proc/sys/fs/pipe-max-size, 1 MiB by default
+#define PIPE_SIZE (1 << 20)
+// Old logs kept when rotating: FILE.1 is the newest, FILE.3 the oldest
+#define ROTATED_LOGS 3
 
-    // Uncomment lines below to use specified output file and command-line args in child process
-    // output file that child process will print into
-    char *output_file = argv[1];
-    // child command/arguments to execute
-    char *child_argv[] = {"wc", "test_cases/resources/nums.txt", NULL};
+// The file the pipeline's output goes into
+typedef struct {
+    const char *path;
+    int fd;
+    off_t size;        // bytes written to the current file
+    off_t max_size;    // rotate once the file reaches this size, 0 to never rotate
+    int use_splice;    // cleared if the file turns out not to support splice()
+} log_file_t;
 
-    // TODO: Spawn a child process, which will exec the "wc" command with the arguments in
-    // 'child_argv' Redirect the output of the command to 'output_file'
+/*
+ * Create a close-on-exec pipe and try to enlarge it to PIPE_SIZE; a pipe
+ * that can't be enlarged still works at the default size
+ * Returns 0 on success and -1 on error
+ */
+static int make_pipe(int fds[2]) {
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        perror("pipe");
+        return -1;
+    }
+    fcntl(fds[1], F_SETPIPE_SZ, PIPE_SIZE);
+    return 0;
+}
 
+/*
+ * Fork a child that reads from 'in_fd', writes output to 'out_fd' and errors
+ * to 'err_fd', and execs 'child_argv'. Every other descriptor the parent
+ * opened is close-on-exec
+ * Returns the child's pid, or -1 on error
+ */
+static pid_t start_stage(char **child_argv, int in_fd, int out_fd, int err_fd) {
     pid_t pid = fork();
-
     if (pid == -1) {
         perror("fork");
-        return 1;
+        return -1;
     }
-
     if (pid == 0) {
-        int fd = open(output_file, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
-        if (fd == -1) {
-            perror("open");
+        if ((in_fd != STDIN_FILENO && dup2(in_fd, STDIN_FILENO) == -1) ||
+            dup2(out_fd, STDOUT_FILENO) == -1 ||
+            (err_fd != STDERR_FILENO && dup2(err_fd, STDERR_FILENO) == -1)) {
+            perror("dup2");
             exit(1);
         }
+        execvp(child_argv[0], child_argv);
+        perror("execvp");
+        exit(1);
+    }
+    return pid;
+}
 
-        if (dup2(fd, STDOUT_FILENO) == -1) {
-            perror("dup2");
-            close(fd);
-            exit(1);
+/*
+ * Move up to 'len' bytes from the pipe 'in_fd' to 'out_fd' in one step.
+ * splice() hands the pipe's pages over without copying them through this
+ * process; '*use_splice' is cleared and read()/write() used instead once
+ * 'out_fd' turns out not to support it
+ * Returns the number of bytes moved, 0 at end of input, or -1 on error
+ */
+static ssize_t move_bytes(int in_fd, int out_fd, size_t len, int *use_splice) {
+    while (1) {
+        ssize_t nbytes;
+        if (*use_splice) {
+            nbytes = splice(in_fd, NULL, out_fd, NULL, len, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (nbytes == -1 && errno == EINVAL) {
+                *use_splice = 0;
+                continue;
+            }
+        } else {
+            char buf[4096];
+            nbytes = read(in_fd, buf, len < sizeof(buf) ? len : sizeof(buf));
+            if (nbytes > 0 && write(out_fd, buf, nbytes) != nbytes) {
+                nbytes = -1;
+            }
+        }
+        if (nbytes != -1 || errno != EINTR) {
+            return nbytes;
         }
+    }
+}
 
-        close(fd);
+/*
+ * Open the log file, emptying it
+ * Returns 0 on success and -1 on error
+ */
+static int log_open(log_file_t *log) {
+    log->fd = open(log->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (log->fd == -1) {
+        perror("open");
+        return -1;
+    }
+    log->size = 0;
+    return 0;
+}
 
-        execvp(child_argv[0], child_argv);
+/*
+ * Shift FILE.1 .. FILE.(ROTATED_LOGS - 1) up by one, dropping the oldest,
+ * move the full log to FILE.1 and start a new empty one
+ * Returns 0 on success and -1 on error
+ */
+static int log_rotate(log_file_t *log) {
+    char from[PATH_MAX];
+    char to[PATH_MAX];
+    close(log->fd);
+    for (int i = ROTATED_LOGS; i > 0; i--) {
+        if (i > 1) {
+            snprintf(from, sizeof(from), "%s.%d", log->path, i - 1);
+        } else {
+            snprintf(from, sizeof(from), "%s", log->path);
+        }
+        snprintf(to, sizeof(to), "%s.%d", log->path, i);
+        if (rename(from, to) == -1 && errno != ENOENT) {
+            perror("rename");
+            return -1;
+        }
+    }
+    return log_open(log);
+}
 
-        perror("execvp");
-        exit(1);
+/*
+ * Move up to 'len' bytes from the pipe 'in_fd' into the log, first rotating
+ * it if it is full. Never writes past the size limit, so a log only grows
+ * beyond 'max_size' when the limit is 0
+ * Returns the number of bytes moved, 0 at end of input, or -1 on error
+ */
+static ssize_t log_splice(log_file_t *log, int in_fd, size_t len) {
+    if (log->max_size > 0) {
+        if (log->size >= log->max_size && log_rotate(log) == -1) {
+            return -1;
+        }
+        if ((off_t) len > log->max_size - log->size) {
+            len = log->max_size - log->size;
+        }
+    }
+    ssize_t nbytes = move_bytes(in_fd, log->fd, len, &log->use_splice);
+    if (nbytes == -1) {
+        perror("splice");
+    } else {
+        log->size += nbytes;
     }
+    return nbytes;
+}
 
-    // TODO: In the parent, wait for the child and ensure it terminated normally using wait macros
-    // Print "Child complete, return code <status_code>" if child terminated normally, replacing
-    //    <status_code> with the child's numerical status code
-    // Print "Child exited abnormally" if child terminated abnormally
+/*
+ * Move everything written into the pipe 'in_fd' to the log until the writing
+ * end closes
+ * Returns 0 on success and -1 on error
+ */
+static int drain_pipe(int in_fd, log_file_t *log) {
+    ssize_t nbytes;
+    while ((nbytes = log_splice(log, in_fd, PIPE_SIZE)) > 0) {
+    }
+    return nbytes == 0 ? 0 : -1;
+}
+
+/*
+ * Like drain_pipe(), but also copy everything to 'out_fd'. tee() duplicates
+ * the pipe's contents into a second pipe without consuming them, so each
+ * chunk reaches both the log and 'out_fd' while staying in the kernel
+ * Returns 0 on success and -1 on error
+ */
+static int tee_pipe(int in_fd, log_file_t *log, int out_fd) {
+    int copy[2];
+    if (make_pipe(copy) == -1) {
+        return -1;
+    }
+    int use_splice = 1;
+    int result = 0;
+    while (result == 0) {
+        ssize_t nbytes = tee(in_fd, copy[1], PIPE_SIZE, 0);
+        if (nbytes == 0) {
+            break;
+        }
+        if (nbytes == -1) {
+            if (errno != EINTR) {
+                perror("tee");
+                result = -1;
+            }
+            continue;
+        }
+        // Consume exactly what was duplicated, from both pipes
+        for (ssize_t left = nbytes; left > 0 && result == 0;) {
+            ssize_t moved = log_splice(log, in_fd, left);
+            result = moved > 0 ? 0 : -1;
+            left -= moved;
+        }
+        for (ssize_t left = nbytes; left > 0 && result == 0;) {
+            ssize_t moved = move_bytes(copy[0], out_fd, left, &use_splice);
+            if (moved <= 0) {
+                perror("splice");
+                result = -1;
+            }
+            left -= moved;
+        }
+    }
+    close(copy[0]);
+    close(copy[1]);
+    return result;
+}
 
-    int status;
-    if (wait(&status) == -1) {
-        perror("wait");
+int main(int argc, char *argv[]) {
+    int capture = 0;
+    log_file_t log = {.use_splice = 1};
+    int opt;
+    // '+' stops at the first non-option so the commands keep their own options
+    while ((opt = getopt(argc, argv, "+tr:")) != -1) {
+        if (opt == 't') {
+            capture = 1;
+        } else if (opt == 'r' && atoll(optarg) > 0) {
+            log.max_size = atoll(optarg);
+        } else {
+            optind = argc;    // falls through to the usage message
+            break;
+        }
+    }
+    if (optind >= argc) {    // check for at least 1 command line arg
+        printf("Usage: %s [-t] [-r MAX_BYTES] <childfile> [command [args] ['|' command "
+               "[args]]...]\n",
+               argv[0]);
+        printf("-t also shows the output, and every command's errors, on the screen\n"
+               "-r moves <childfile> to <childfile>.1 when it reaches MAX_BYTES, keeping %d "
+               "old files\n",
+               ROTATED_LOGS);
         return 1;
     }
 
-    if (WIFEXITED(status)) {
-        int exit_code = WEXITSTATUS(status);
-        printf("Child complete, return code %d\n", exit_code);
-    } else {
-        printf("Child exited abnormally\n");
+    // output file that the last child process will print into
+    log.path = argv[optind];
+    // child command/arguments to execute when none are given
+    char *child_argv[] = {"wc", "test_cases/resources/nums.txt", NULL};
+
+    // Split the remaining arguments into one argv per stage at each "|"
+    char **stages[MAX_STAGES] = {child_argv};
+    int num_stages = 1;
+    if (optind + 1 < argc) {
+        stages[0] = &argv[optind + 1];
+        for (int i = optind + 1; i < argc; i++) {
+            if (strcmp(argv[i], "|") != 0) {
+                continue;
+            }
+            argv[i] = NULL;
+            if (num_stages == MAX_STAGES) {
+                printf("At most %d commands are supported\n", MAX_STAGES);
+                return 1;
+            }
+            stages[num_stages++] = &argv[i + 1];
+        }
+        for (int i = 0; i < num_stages; i++) {
+            if (stages[i][0] == NULL) {
+                printf("Empty command in pipeline\n");
+                return 1;
+            }
+        }
     }
 
-    return 0;
+    // When the parent has to move the output, to copy or rotate it, the last
+    // stage writes into the output pipe, which the parent drains into the
+    // output file, and when capturing every stage's errors go there too.
+    // Otherwise the last stage writes straight into the file
+    int relay = capture || log.max_size > 0;
+    int output[2] = {-1, -1};
+    if (log_open(&log) == -1 || (relay && make_pipe(output) == -1)) {
+        return 1;
+    }
+    int last_fd = relay ? output[1] : log.fd;
+    int err_fd = capture ? output[1] : STDERR_FILENO;
+
+    // Each stage reads the previous stage's pipe
+    pid_t pids[MAX_STAGES];
+    int started = 0;
+    int in_fd = STDIN_FILENO;
+    int result = 0;
+    while (started < num_stages) {
+        int fds[2] = {-1, last_fd};
+        if (started < num_stages - 1 && make_pipe(fds) == -1) {
+            result = -1;
+            break;
+        }
+        pids[started] = start_stage(stages[started], in_fd, fds[1], err_fd);
+        if (fds[1] != last_fd) {
+            close(fds[1]);
+        }
+        if (in_fd != STDIN_FILENO) {
+            close(in_fd);
+        }
+        in_fd = fds[0];
+        if (pids[started] == -1) {
+            result = -1;
+            break;
+        }
+        started++;
+    }
+    if (in_fd != STDIN_FILENO && in_fd != -1) {
+        close(in_fd);
+    }
+    if (relay) {
+        close(output[1]);
+        if (result == 0 && capture) {
+            result = tee_pipe(output[0], &log, STDOUT_FILENO);
+        } else if (result == 0) {
+            result = drain_pipe(output[0], &log);
+        }
+        // Closing the read end early makes any stage still writing get SIGPIPE
+        close(output[0]);
+    }
+    close(log.fd);
+
+    // Wait for every stage and report how each one terminated
+    for (int i = 0; i < started; i++) {
+        int status;
+        if (waitpid(pids[i], &status, 0) == -1) {
+            perror("waitpid");
+            return 1;
+        }
+        if (num_stages == 1 && WIFEXITED(status)) {
+            printf("Child complete, return code %d\n", WEXITSTATUS(status));
+        } else if (num_stages == 1) {
+            printf("Child exited abnormally\n");
+        } else if (WIFEXITED(status)) {
+            printf("Stage %d (%s) complete, return code %d\n", i + 1, stages[i][0],
+                   WEXITSTATUS(status));
+        } else if (WIFSIGNALED(status)) {
+            printf("Stage %d (%s) killed by signal %d\n", i + 1, stages[i][0], WTERMSIG(status));
+        } else {
+            printf("Stage %d (%s) exited abnormally\n", i + 1, stages[i][0]);
+        }
+    }
+
+    return result == 0 ? 0 : 1;
 }
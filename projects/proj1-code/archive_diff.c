@@ -0,0 +1,297 @@
+#include "archive_diff.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "archive_index.h"
+#include "minitar.h"
+#include "minitar_stats.h"
+
+#define COMPARE_BUF_SIZE (64 * 1024)
+#define MAX_DIFF_THREADS 8
+
+// Kinds of difference between an archived file and its counterpart on disk
+#define DIFF_MISSING 0x01
+#define DIFF_NOT_IN_ARCHIVE 0x02
+#define DIFF_TYPE 0x04
+#define DIFF_SIZE 0x08
+#define DIFF_MODE 0x10
+#define DIFF_CONTENTS 0x20
+
+typedef struct {
+    // Name of the file, null-terminated
+    char name[sizeof(((tar_header *) 0)->name) + 1];
+    // Newest archived version of the file, NULL if the archive lacks it
+    const archive_entry_t *entry;
+    // Bitwise OR of the DIFF_* constants that apply
+    int differences;
+    // Set when the metadata can't settle whether the contents differ
+    int check_contents;
+    // errno value describing why the contents could not be compared, or 0
+    int error;
+} diff_item_t;
+
+// Queue of content comparisons shared by the worker threads
+typedef struct {
+    diff_item_t **items;
+    int num_items;
+    int next;
+    int archive_fd;
+    pthread_mutex_t lock;
+} diff_work_t;
+
+/*
+ * Compares the body of 'entry' in the archive open as 'archive_fd' against the
+ * file 'file_name' block by block, stopping at the first block that differs
+ * Returns 1 if the contents differ, 0 if they match, or -1 if an error occurs
+ */
+static int compare_contents(int archive_fd, const archive_entry_t *entry, const char *file_name) {
+    int fd = open(file_name, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+    char *archive_buf = malloc(COMPARE_BUF_SIZE);
+    char *file_buf = malloc(COMPARE_BUF_SIZE);
+    if (archive_buf == NULL || file_buf == NULL) {
+        free(archive_buf);
+        free(file_buf);
+        close(fd);
+        return -1;
+    }
+
+    int result = 0;
+    off_t pos = 0;
+    while (pos < entry->size) {
+        size_t chunk = entry->size - pos < COMPARE_BUF_SIZE ? entry->size - pos : COMPARE_BUF_SIZE;
+        ssize_t archive_read = pread(archive_fd, archive_buf, chunk, entry->data_offset + pos);
+        ssize_t file_read = pread(fd, file_buf, chunk, pos);
+        if (archive_read != chunk) {
+            if (archive_read != -1) {
+                errno = EIO;    // archive ends in the middle of the member
+            }
+            result = -1;
+            break;
+        }
+        // The file may have been shortened since it was stat'ed
+        if (file_read != chunk || memcmp(archive_buf, file_buf, chunk) != 0) {
+            result = file_read == -1 ? -1 : 1;
+            break;
+        }
+        pos += chunk;
+    }
+
+    free(archive_buf);
+    free(file_buf);
+    close(fd);
+    return result;
+}
+
+/*
+ * Thread start routine: takes comparisons off the shared queue until it is empty
+ */
+static void *compare_worker(void *arg) {
+    diff_work_t *work = arg;
+    while (1) {
+        pthread_mutex_lock(&work->lock);
+        int i = work->next++;
+        pthread_mutex_unlock(&work->lock);
+        if (i >= work->num_items) {
+            return NULL;
+        }
+
+        diff_item_t *item = work->items[i];
+        int result = compare_contents(work->archive_fd, item->entry, item->name);
+        if (result == -1) {
+            item->error = errno;
+        } else if (result == 1) {
+            item->differences |= DIFF_CONTENTS;
+        }
+    }
+}
+
+/*
+ * Runs all pending content comparisons among the 'num_items' items, spread
+ * over up to MAX_DIFF_THREADS threads
+ * Returns 0 on success or -1 if an error occurs
+ */
+static int run_comparisons(diff_item_t *items, int num_items, int archive_fd) {
+    diff_work_t work;
+    work.items = malloc(num_items * sizeof(diff_item_t *));
+    if (work.items == NULL) {
+        perror("Failed to allocate comparison queue");
+        return -1;
+    }
+    work.num_items = 0;
+    work.next = 0;
+    work.archive_fd = archive_fd;
+    for (int i = 0; i < num_items; i++) {
+        if (items[i].check_contents) {
+            work.items[work.num_items++] = &items[i];
+        }
+    }
+    pthread_mutex_init(&work.lock, NULL);
+
+    long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_threads > MAX_DIFF_THREADS) {
+        num_threads = MAX_DIFF_THREADS;
+    }
+    if (num_threads > work.num_items) {
+        num_threads = work.num_items;
+    }
+
+    pthread_t threads[MAX_DIFF_THREADS];
+    int num_started = 0;
+    for (int i = 0; i < num_threads; i++) {
+        if (pthread_create(&threads[i], NULL, compare_worker, &work) != 0) {
+            break;
+        }
+        num_started++;
+    }
+    // Finish whatever is left on this thread if none could be started
+    if (num_started == 0) {
+        compare_worker(&work);
+    }
+    for (int i = 0; i < num_started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&work.lock);
+    free(work.items);
+    return 0;
+}
+
+/*
+ * Fills in the differences that can be determined from metadata alone,
+ * marking the item for a content comparison when the metadata is ambiguous
+ */
+static void check_metadata(diff_item_t *item) {
+    if (item->entry == NULL) {
+        item->differences |= DIFF_NOT_IN_ARCHIVE;
+        return;
+    }
+
+    struct stat stat_buf;
+    if (fstatat(AT_FDCWD, item->name, &stat_buf, 0) != 0) {
+        item->differences |= DIFF_MISSING;
+        return;
+    }
+    if (!S_ISREG(stat_buf.st_mode)) {
+        item->differences |= DIFF_TYPE;
+        return;
+    }
+
+    const tar_header *header = &item->entry->header;
+    unsigned long long mode = 0;
+    unsigned long long mtime = 0;
+    parse_octal_field(header->mode, sizeof(header->mode), &mode);
+    parse_octal_field(header->mtime, sizeof(header->mtime), &mtime);
+
+    if ((stat_buf.st_mode & 07777) != mode) {
+        item->differences |= DIFF_MODE;
+    }
+    if (stat_buf.st_size != item->entry->size) {
+        item->differences |= DIFF_SIZE;
+    } else if (stat_buf.st_mtime != mtime && item->entry->size > 0) {
+        // Same size, but touched since it was archived: only the bytes can tell
+        item->check_contents = 1;
+    }
+}
+
+/*
+ * Prints one line for each difference recorded for 'item'
+ */
+static void print_differences(const diff_item_t *item) {
+    if (item->differences & DIFF_NOT_IN_ARCHIVE) {
+        printf("%s: Not found in archive\n", item->name);
+    }
+    if (item->differences & DIFF_MISSING) {
+        printf("%s: Does not exist\n", item->name);
+    }
+    if (item->differences & DIFF_TYPE) {
+        printf("%s: File type differs\n", item->name);
+    }
+    if (item->differences & DIFF_MODE) {
+        printf("%s: Mode differs\n", item->name);
+    }
+    if (item->differences & DIFF_SIZE) {
+        printf("%s: Size differs\n", item->name);
+    }
+    if (item->differences & DIFF_CONTENTS) {
+        printf("%s: Contents differ\n", item->name);
+    }
+}
+
+int diff_archive(const char *archive_name, const file_list_t *files, int *num_differences) {
+    int archive_fd = open(archive_name, O_RDONLY);
+    if (archive_fd == -1) {
+        perror("cannot open archive file");
+        return -1;
+    }
+
+    archive_index_t index;
+    archive_index_init(&index);
+    if (archive_index_build(&index, archive_fd) != 0) {
+        close(archive_fd);
+        return -1;
+    }
+
+    int num_items = files->size > 0 ? files->size : index.count;
+    diff_item_t *items = calloc(num_items > 0 ? num_items : 1, sizeof(diff_item_t));
+    if (items == NULL) {
+        perror("Failed to allocate diff results");
+        archive_index_clear(&index);
+        close(archive_fd);
+        return -1;
+    }
+
+    // Either the named files or the newest version of every archived file
+    num_items = 0;
+    if (files->size > 0) {
+        for (node_t *current = files->head; current != NULL; current = current->next) {
+            diff_item_t *item = &items[num_items++];
+            strncpy(item->name, current->name, sizeof(item->name) - 1);
+            item->entry = archive_index_find(&index, current->name);
+        }
+    } else {
+        for (int i = 0; i < index.count; i++) {
+            if (archive_index_is_newest(&index, i)) {
+                diff_item_t *item = &items[num_items++];
+                memcpy(item->name, index.entries[i].header.name, sizeof(item->name) - 1);
+                item->entry = &index.entries[i];
+            }
+        }
+    }
+
+    for (int i = 0; i < num_items; i++) {
+        check_metadata(&items[i]);
+    }
+    // Timed here rather than in the workers, which must not touch the stats
+    double start = stats_begin();
+    int result = run_comparisons(items, num_items, archive_fd);
+    stats_end(PHASE_ARCHIVE_READ, start);
+
+    // Report in archive order once every comparison has finished
+    *num_differences = 0;
+    for (int i = 0; i < num_items; i++) {
+        if (items[i].error != 0) {
+            fprintf(stderr, "%s: Failed to compare contents: %s\n", items[i].name,
+                    strerror(items[i].error));
+            result = -1;
+        }
+        print_differences(&items[i]);
+        if (items[i].differences != 0) {
+            (*num_differences)++;
+        }
+    }
+
+    free(items);
+    archive_index_clear(&index);
+    close(archive_fd);
+    return result;
+}
@@ -0,0 +1,19 @@
+#ifndef _ARCHIVE_DIFF_H
+#define _ARCHIVE_DIFF_H
+
+#include "file_list.h"
+
+/*
+ * Compare the newest version of each file in the archive identified by
+ * 'archive_name' against the file of the same name in the current working
+ * directory, printing one line for each difference found.
+ * If 'files' is not empty, only the files it names are compared.
+ * Size and mode are compared from metadata alone. File contents are read and
+ * compared only when the sizes match but the modification times don't, and
+ * these comparisons run in parallel.
+ * The number of differing files is stored in 'num_differences'.
+ * This function should return 0 upon success or -1 if an error occurred.
+ */
+int diff_archive(const char *archive_name, const file_list_t *files, int *num_differences);
+
+#endif    // _ARCHIVE_DIFF_H
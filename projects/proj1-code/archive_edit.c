@@ -0,0 +1,384 @@
+#define _GNU_SOURCE    // copy_file_range(), fallocate()
+#include "archive_edit.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "archive_index.h"
+#include "minitar.h"
+
+#define MOVE_BUF_SIZE (1024 * 1024)
+#define MAX_KERNEL_CHUNK (64 * 1024 * 1024)
+// Below this distance the many small copy_file_range() calls needed to avoid
+// overlapping ranges cost more than moving the bytes through a buffer
+#define MIN_KERNEL_MOVE (1024 * 1024)
+
+// A run of bytes to be cut out of the archive
+typedef struct {
+    off_t start;
+    off_t end;
+} gap_t;
+
+/*
+ * Reads exactly 'len' bytes at 'offset' of 'fd' into 'buf'
+ * Returns 0 on success or -1 if an error occurs or the file ends first
+ */
+static int pread_full(int fd, void *buf, size_t len, off_t offset) {
+    char *bytes = buf;
+    while (len > 0) {
+        ssize_t bytes_read = pread(fd, bytes, len, offset);
+        if (bytes_read == -1 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_read <= 0) {
+            return -1;
+        }
+        bytes += bytes_read;
+        offset += bytes_read;
+        len -= bytes_read;
+    }
+    return 0;
+}
+
+/*
+ * Writes exactly 'len' bytes from 'buf' at 'offset' of 'fd'
+ * Returns 0 on success or -1 if an error occurs
+ */
+static int pwrite_full(int fd, const void *buf, size_t len, off_t offset) {
+    const char *bytes = buf;
+    while (len > 0) {
+        ssize_t bytes_written = pwrite(fd, bytes, len, offset);
+        if (bytes_written == -1 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_written <= 0) {
+            return -1;
+        }
+        bytes += bytes_written;
+        offset += bytes_written;
+        len -= bytes_written;
+    }
+    return 0;
+}
+
+/*
+ * Copies 'len' bytes at offset 'src' of 'in_fd' to offset 'dst' of 'out_fd'
+ * through a userspace buffer
+ * Returns 0 on success or -1 if an error occurs
+ */
+static int buffered_copy(int in_fd, off_t src, int out_fd, off_t dst, off_t len) {
+    char *buffer = malloc(MOVE_BUF_SIZE);
+    if (buffer == NULL) {
+        perror("Failed to allocate copy buffer");
+        return -1;
+    }
+    while (len > 0) {
+        size_t chunk = len < MOVE_BUF_SIZE ? len : MOVE_BUF_SIZE;
+        if (pread_full(in_fd, buffer, chunk, src) != 0 ||
+            pwrite_full(out_fd, buffer, chunk, dst) != 0) {
+            perror("Failed to copy archive data");
+            free(buffer);
+            return -1;
+        }
+        src += chunk;
+        dst += chunk;
+        len -= chunk;
+    }
+    free(buffer);
+    return 0;
+}
+
+/*
+ * Copies 'len' bytes at offset 'src' of 'in_fd' to offset 'dst' of 'out_fd'
+ * inside the kernel with copy_file_range(), never more than 'max_chunk'
+ * bytes per call. Falls back to a buffered copy where the kernel can't do it
+ * Returns 0 on success or -1 if an error occurs
+ */
+static int copy_range(int in_fd, off_t src, int out_fd, off_t dst, off_t len, off_t max_chunk) {
+    if (max_chunk > MAX_KERNEL_CHUNK) {
+        max_chunk = MAX_KERNEL_CHUNK;
+    }
+    while (len > 0) {
+        size_t chunk = len < max_chunk ? len : max_chunk;
+        off_t in_offset = src;
+        off_t out_offset = dst;
+        ssize_t bytes_copied = copy_file_range(in_fd, &in_offset, out_fd, &out_offset, chunk, 0);
+        if (bytes_copied == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL) {
+                return buffered_copy(in_fd, src, out_fd, dst, len);
+            }
+            perror("Failed to copy archive data");
+            return -1;
+        }
+        if (bytes_copied == 0) {
+            fprintf(stderr, "Archive ended unexpectedly while copying data\n");
+            return -1;
+        }
+        src += bytes_copied;
+        dst += bytes_copied;
+        len -= bytes_copied;
+    }
+    return 0;
+}
+
+/*
+ * Moves 'len' bytes at offset 'src' of 'fd' down to the lower offset 'dst'
+ * The kernel copies the data when the distance is large enough; each chunk is
+ * no longer than the distance so that source and destination never overlap
+ * Returns 0 on success or -1 if an error occurs
+ */
+static int move_down(int fd, off_t src, off_t dst, off_t len) {
+    off_t distance = src - dst;
+    if (distance >= MIN_KERNEL_MOVE) {
+        return copy_range(fd, src, fd, dst, len, distance);
+    }
+    return buffered_copy(fd, src, fd, dst, len);
+}
+
+/*
+ * Removes gaps from the end of the list for as long as they are aligned to the
+ * filesystem's block size, letting the filesystem drop them with
+ * FALLOC_FL_COLLAPSE_RANGE instead of moving any data. '*num_gaps' and
+ * '*file_size' are updated to reflect the gaps that were collapsed
+ */
+static void collapse_aligned_gaps(int fd, const gap_t *gaps, int *num_gaps, off_t *file_size,
+                                  off_t block_size) {
+    while (*num_gaps > 0) {
+        const gap_t *gap = &gaps[*num_gaps - 1];
+        off_t len = gap->end - gap->start;
+        // The collapsed range may not reach the end of the file
+        if (gap->start % block_size != 0 || len % block_size != 0 || gap->end >= *file_size) {
+            return;
+        }
+        if (fallocate(fd, FALLOC_FL_COLLAPSE_RANGE, gap->start, len) != 0) {
+            return;
+        }
+        *file_size -= len;
+        (*num_gaps)--;
+    }
+}
+
+int delete_files_from_archive(const char *archive_name, const file_list_t *files) {
+    int fd = open(archive_name, O_RDWR);
+    if (fd == -1) {
+        perror("cannot open archive file");
+        return -1;
+    }
+
+    archive_index_t index;
+    archive_index_init(&index);
+    if (archive_index_build(&index, fd) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    // Check every name before touching the archive
+    int result = 0;
+    for (node_t *current = files->head; current != NULL; current = current->next) {
+        if (archive_index_find(&index, current->name) == NULL) {
+            fprintf(stderr, "%s: Not found in archive\n", current->name);
+            result = -1;
+        }
+    }
+
+    struct stat stat_buf;
+    gap_t *gaps = malloc((index.count > 0 ? index.count : 1) * sizeof(gap_t));
+    if (result == 0 && (gaps == NULL || fstat(fd, &stat_buf) != 0)) {
+        perror("Failed to prepare archive for deletion");
+        result = -1;
+    }
+    if (result != 0) {
+        free(gaps);
+        archive_index_clear(&index);
+        close(fd);
+        return -1;
+    }
+
+    // Adjacent removed members are merged into a single gap
+    off_t file_size = stat_buf.st_size;
+    int num_gaps = 0;
+    for (int i = 0; i < index.count; i++) {
+        const archive_entry_t *entry = &index.entries[i];
+        char name[sizeof(entry->header.name) + 1];
+        memcpy(name, entry->header.name, sizeof(entry->header.name));
+        name[sizeof(entry->header.name)] = '\0';
+        if (!file_list_contains(files, name)) {
+            continue;
+        }
+
+        off_t end = entry->data_offset + (entry->size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+        if (end > file_size) {
+            end = file_size;
+        }
+        if (num_gaps > 0 && gaps[num_gaps - 1].end == entry->header_offset) {
+            gaps[num_gaps - 1].end = end;
+        } else {
+            gaps[num_gaps].start = entry->header_offset;
+            gaps[num_gaps].end = end;
+            num_gaps++;
+        }
+    }
+
+    collapse_aligned_gaps(fd, gaps, &num_gaps, &file_size, stat_buf.st_blksize);
+
+    // Slide everything after the first remaining gap down in one pass, so each
+    // byte moves at most once no matter how many members are removed
+    if (num_gaps > 0) {
+        off_t write_pos = gaps[0].start;
+        for (int i = 0; i < num_gaps && result == 0; i++) {
+            off_t keep_start = gaps[i].end;
+            off_t keep_end = i + 1 < num_gaps ? gaps[i + 1].start : file_size;
+            result = move_down(fd, keep_start, write_pos, keep_end - keep_start);
+            write_pos += keep_end - keep_start;
+        }
+        file_size = write_pos;
+    }
+
+    if (result == 0 && ftruncate(fd, file_size) != 0) {
+        perror("Failed to truncate archive");
+        result = -1;
+    }
+
+    free(gaps);
+    archive_index_clear(&index);
+    close(fd);
+    return result;
+}
+
+/*
+ * Finds the offset of the end-of-archive marker in the archive open as 'fd',
+ * which is also the total length of its members
+ * Returns 0 on success or -1 if an error occurs
+ */
+static int find_archive_end(int fd, off_t *end) {
+    off_t pos = 0;
+    archive_entry_t entry;
+    int result;
+    while ((result = read_archive_entry(fd, &pos, &entry)) == 1) {
+    }
+    if (result == -1) {
+        return -1;
+    }
+    // A final member cut short would leave 'pos' past the end of the file
+    struct stat stat_buf;
+    if (fstat(fd, &stat_buf) != 0) {
+        perror("Failed to stat archive");
+        return -1;
+    }
+    if (pos > stat_buf.st_size) {
+        fprintf(stderr, "Archive ends in the middle of a member\n");
+        return -1;
+    }
+    *end = pos;
+    return 0;
+}
+
+/*
+ * Opens each archive named in 'sources' and finds where its members end,
+ * refusing any that is the archive described by 'target_stat'
+ * Every source is checked before the target is touched, so a missing or
+ * damaged source leaves the target unchanged
+ * Returns 0 on success, with the open descriptors in 'source_fds' and the
+ * member lengths in 'source_ends', or -1 if an error occurs
+ */
+static int open_sources(const file_list_t *sources, const struct stat *target_stat,
+                        int *source_fds, off_t *source_ends) {
+    int num_open = 0;
+    int result = 0;
+    for (node_t *current = sources->head; current != NULL && result == 0;
+         current = current->next) {
+        int source_fd = open(current->name, O_RDONLY);
+        if (source_fd == -1) {
+            perror("cannot open source archive");
+            result = -1;
+            break;
+        }
+        source_fds[num_open++] = source_fd;
+
+        struct stat source_stat;
+        if (fstat(source_fd, &source_stat) != 0) {
+            perror("Failed to stat source archive");
+            result = -1;
+        } else if (source_stat.st_dev == target_stat->st_dev &&
+                   source_stat.st_ino == target_stat->st_ino) {
+            fprintf(stderr, "%s: Cannot concatenate an archive onto itself\n", current->name);
+            result = -1;
+        } else if (find_archive_end(source_fd, &source_ends[num_open - 1]) != 0) {
+            result = -1;
+        }
+    }
+    if (result != 0) {
+        for (int i = 0; i < num_open; i++) {
+            close(source_fds[i]);
+        }
+    }
+    return result;
+}
+
+int concatenate_archives(const char *archive_name, const file_list_t *sources) {
+    int fd = open(archive_name, O_RDWR);
+    if (fd == -1) {
+        perror("cannot open archive file");
+        return -1;
+    }
+    struct stat target_stat;
+    off_t end_pos;
+    if (fstat(fd, &target_stat) != 0 || find_archive_end(fd, &end_pos) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    int num_sources = sources->size;
+    int *source_fds = malloc((num_sources > 0 ? num_sources : 1) * sizeof(int));
+    off_t *source_ends = malloc((num_sources > 0 ? num_sources : 1) * sizeof(off_t));
+    if (source_fds == NULL || source_ends == NULL) {
+        perror("Failed to prepare concatenation");
+        free(source_fds);
+        free(source_ends);
+        close(fd);
+        return -1;
+    }
+    if (open_sources(sources, &target_stat, source_fds, source_ends) != 0) {
+        free(source_fds);
+        free(source_ends);
+        close(fd);
+        return -1;
+    }
+
+    // Each source's members are written over the previous end-of-archive marker
+    int result = 0;
+    off_t write_pos = end_pos;
+    for (int i = 0; i < num_sources; i++) {
+        if (result == 0 &&
+            copy_range(source_fds[i], 0, fd, write_pos, source_ends[i], MAX_KERNEL_CHUNK) != 0) {
+            result = -1;
+        }
+        write_pos += source_ends[i];
+        close(source_fds[i]);
+    }
+    free(source_fds);
+    free(source_ends);
+
+    // On failure the original end-of-archive marker and length are put back
+    // so the target still holds exactly its old members
+    char zero_blocks[NUM_TRAILING_BLOCKS * BLOCK_SIZE];
+    memset(zero_blocks, 0, sizeof(zero_blocks));
+    off_t trailer_pos = result == 0 ? write_pos : end_pos;
+    off_t final_size = result == 0 ? write_pos + (off_t) sizeof(zero_blocks) : target_stat.st_size;
+    if (pwrite_full(fd, zero_blocks, sizeof(zero_blocks), trailer_pos) != 0 ||
+        ftruncate(fd, final_size) != 0) {
+        perror("cannot write TAR termination blocks");
+        result = -1;
+    }
+
+    close(fd);
+    return result;
+}
@@ -0,0 +1,26 @@
+#ifndef _ARCHIVE_EDIT_H
+#define _ARCHIVE_EDIT_H
+
+#include "file_list.h"
+
+/*
+ * Remove every version of each file named in 'files' from the archive
+ * identified by 'archive_name', rewriting the archive in place.
+ * Members after a removed one are moved down over the gap. The kernel does the
+ * moving where possible, so only the data after the first removed member is
+ * touched. The archive is then truncated to its new length.
+ * Nothing is changed if any of the named files is not present in the archive.
+ * This function should return 0 upon success or -1 if an error occurred.
+ */
+int delete_files_from_archive(const char *archive_name, const file_list_t *files);
+
+/*
+ * Append the members of each archive named in 'sources' to the archive
+ * identified by 'archive_name', in order.
+ * The member data of each source is copied as-is, inside the kernel where
+ * possible; no headers are rebuilt and no member files need to exist.
+ * This function should return 0 upon success or -1 if an error occurred.
+ */
+int concatenate_archives(const char *archive_name, const file_list_t *sources);
+
+#endif    // _ARCHIVE_EDIT_H
@@ -0,0 +1,260 @@
+#define _GNU_SOURCE
+
+#include "archive_extract.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "archive_io.h"
+#include "minitar.h"
+#include "minitar_stats.h"
+
+// Most directory descriptors kept open at once
+#define DIR_CACHE_SIZE 32
+#define NAME_LEN sizeof(((tar_header *) 0)->name)
+
+// An open directory, named by its path relative to the extraction directory
+typedef struct {
+    char path[NAME_LEN + 1];
+    int fd;
+    unsigned long last_used;
+} cached_dir_t;
+
+typedef struct {
+    // The extraction directory itself, never evicted
+    int root_fd;
+    cached_dir_t dirs[DIR_CACHE_SIZE];
+    int count;
+    unsigned long clock;
+} dir_cache_t;
+
+/*
+ * Opens 'dir_name' as the root of an empty cache
+ * Returns 0 on success or -1 if an error occurs
+ */
+static int dir_cache_init(dir_cache_t *cache, const char *dir_name) {
+    cache->root_fd = open(dir_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cache->root_fd == -1) {
+        perror("cannot open extraction directory");
+        return -1;
+    }
+    cache->count = 0;
+    cache->clock = 0;
+    return 0;
+}
+
+/*
+ * Closes every directory held by the cache
+ */
+static void dir_cache_clear(dir_cache_t *cache) {
+    for (int i = 0; i < cache->count; i++) {
+        close(cache->dirs[i].fd);
+    }
+    cache->count = 0;
+    close(cache->root_fd);
+}
+
+/*
+ * Adds the directory 'path', open as 'fd', to the cache, closing the least
+ * recently used directory to make room if the cache is full
+ */
+static void dir_cache_insert(dir_cache_t *cache, const char *path, size_t len, int fd) {
+    cached_dir_t *slot;
+    if (cache->count < DIR_CACHE_SIZE) {
+        slot = &cache->dirs[cache->count++];
+    } else {
+        slot = &cache->dirs[0];
+        for (int i = 1; i < DIR_CACHE_SIZE; i++) {
+            if (cache->dirs[i].last_used < slot->last_used) {
+                slot = &cache->dirs[i];
+            }
+        }
+        close(slot->fd);
+    }
+    memcpy(slot->path, path, len);
+    slot->path[len] = '\0';
+    slot->fd = fd;
+    slot->last_used = ++cache->clock;
+}
+
+/*
+ * Gets a descriptor for the directory named by the first 'len' bytes of
+ * 'path', creating it and any missing parents with mkdirat(). Each directory
+ * not already cached is opened relative to its parent's descriptor
+ * The descriptor belongs to the cache and stays valid until the next lookup
+ * Returns the descriptor or -1 if an error occurs
+ */
+static int dir_cache_get(dir_cache_t *cache, const char *path, size_t len) {
+    // Empty and "." components add nothing to a path
+    while (len > 0 && path[len - 1] == '/') {
+        len--;
+    }
+    if (len == 0 || (len == 1 && path[0] == '.')) {
+        return cache->root_fd;
+    }
+    for (int i = 0; i < cache->count; i++) {
+        cached_dir_t *dir = &cache->dirs[i];
+        if (strncmp(dir->path, path, len) == 0 && dir->path[len] == '\0') {
+            dir->last_used = ++cache->clock;
+            return dir->fd;
+        }
+    }
+
+    size_t start = len;
+    while (start > 0 && path[start - 1] != '/') {
+        start--;
+    }
+    char component[NAME_LEN + 1];
+    snprintf(component, sizeof(component), "%.*s", (int) (len - start), path + start);
+    if (strcmp(component, ".") == 0) {
+        return dir_cache_get(cache, path, start);
+    }
+    if (strcmp(component, "..") == 0) {
+        fprintf(stderr, "%.*s: Refusing to extract outside the target directory\n", (int) len,
+                path);
+        return -1;
+    }
+
+    int parent_fd = dir_cache_get(cache, path, start);
+    if (parent_fd == -1) {
+        return -1;
+    }
+    if (mkdirat(parent_fd, component, 0777) != 0 && errno != EEXIST) {
+        perror("cannot make output directory");
+        return -1;
+    }
+    int fd = openat(parent_fd, component, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        perror("cannot open output directory");
+        return -1;
+    }
+    dir_cache_insert(cache, path, len, fd);
+    return fd;
+}
+
+/*
+ * Creates the file 'name' in the directory open as 'dir_fd', replacing any
+ * existing file, even one whose restored mode no longer allows writing
+ * Returns the new file's descriptor or -1 if an error occurs
+ */
+static int create_output(int dir_fd, const char *name) {
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    int fd = openat(dir_fd, name, flags, 0600);
+    if (fd == -1 && (errno == EACCES || errno == ETXTBSY) && unlinkat(dir_fd, name, 0) == 0) {
+        fd = openat(dir_fd, name, flags, 0600);
+    }
+    if (fd == -1) {
+        perror("cannot make output file");
+    }
+    return fd;
+}
+
+/*
+ * Writes the member described by 'entry' from the archive open as
+ * 'archive_fd' to its file, creating its directory if needed
+ * Returns 0 on success or -1 if an error occurs
+ */
+static int extract_member(dir_cache_t *cache, int archive_fd, const archive_entry_t *entry) {
+    const tar_header *header = &entry->header;
+    char path[NAME_LEN + 1];
+    snprintf(path, sizeof(path), "%.*s", (int) NAME_LEN, header->name);
+    // Absolute names are extracted relative to the target directory
+    const char *name = path;
+    while (*name == '/') {
+        name++;
+    }
+    const char *base = strrchr(name, '/');
+    base = base != NULL ? base + 1 : name;
+
+    int dir_fd = dir_cache_get(cache, name, base - name);
+    if (dir_fd == -1) {
+        return -1;
+    }
+    if (header->typeflag == DIRTYPE || *base == '\0') {
+        return dir_cache_get(cache, name, strlen(name)) == -1 ? -1 : 0;
+    }
+    if (strcmp(base, ".") == 0 || strcmp(base, "..") == 0) {
+        fprintf(stderr, "%s: Not a file name\n", name);
+        return -1;
+    }
+
+    int out_fd = create_output(dir_fd, base);
+    if (out_fd == -1) {
+        return -1;
+    }
+
+    // Reserving all of the file's blocks up front lets the file system lay
+    // them out contiguously instead of growing the file piece by piece
+    if (entry->size > 0 && fallocate(out_fd, 0, 0, entry->size) != 0 && errno != EOPNOTSUPP &&
+        errno != ENOSYS) {
+        perror("cannot allocate space for output file");
+        close(out_fd);
+        return -1;
+    }
+    if (copy_archive_range(archive_fd, entry->data_offset, entry->size, out_fd) != 0) {
+        close(out_fd);
+        return -1;
+    }
+
+    unsigned long long mode;
+    unsigned long long mtime;
+    if (parse_octal_field(header->mode, sizeof(header->mode), &mode) != 0 ||
+        parse_octal_field(header->mtime, sizeof(header->mtime), &mtime) != 0) {
+        fprintf(stderr, "%s: Malformed mode or mtime field in archive header\n", name);
+        close(out_fd);
+        return -1;
+    }
+    struct timespec times[2] = {{0, UTIME_OMIT}, {(time_t) mtime, 0}};
+    if (fchmod(out_fd, mode & 07777) != 0 || futimens(out_fd, times) != 0) {
+        perror("cannot restore output file metadata");
+        close(out_fd);
+        return -1;
+    }
+
+    // durable extraction queues each file's writeback here and waits for
+    // all of them once at the end
+    io_start_writeback(out_fd);
+    if (close(out_fd) != 0) {
+        perror("cannot write data to file");
+        return -1;
+    }
+    return 0;
+}
+
+int extract_archive(const char *archive_name, const char *dir_name) {
+    int archive_fd = open(archive_name, O_RDONLY | O_CLOEXEC);
+    if (archive_fd == -1) {
+        perror("cannot open file");
+        return -1;
+    }
+    dir_cache_t cache;
+    if (dir_cache_init(&cache, dir_name) != 0) {
+        close(archive_fd);
+        return -1;
+    }
+
+    archive_entry_t entry;
+    off_t pos = 0;
+    int result;
+    double member_start = stats_begin();
+    while ((result = read_archive_entry(archive_fd, &pos, &entry)) == 1) {
+        if (extract_member(&cache, archive_fd, &entry) != 0) {
+            result = -1;
+            break;
+        }
+        stats_member_done(member_start);
+        member_start = stats_begin();
+    }
+
+    dir_cache_clear(&cache);
+    close(archive_fd);
+    if (result == -1) {
+        return -1;
+    }
+    return io_sync_extracted(dir_name);
+}
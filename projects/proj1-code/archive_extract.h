@@ -0,0 +1,18 @@
+#ifndef _ARCHIVE_EXTRACT_H
+#define _ARCHIVE_EXTRACT_H
+
+/*
+ * Write each file contained within the archive identified by 'archive_name'
+ * as a new file under the directory 'dir_name', creating any parent
+ * directories named in member paths. Later versions of a file overwrite
+ * earlier ones, so the newest version is left in place.
+ * Directories are opened once and kept in a cache of directory descriptors,
+ * so each file is created with openat() relative to its parent rather than by
+ * resolving its full path again. Every file is preallocated to its full size
+ * before its contents are copied in, and its mode and modification time are
+ * restored from its header.
+ * This function should return 0 upon success or -1 if an error occurred.
+ */
+int extract_archive(const char *archive_name, const char *dir_name);
+
+#endif    // _ARCHIVE_EXTRACT_H
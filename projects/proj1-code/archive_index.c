@@ -0,0 +1,121 @@
+#include "archive_index.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_CAPACITY 64
+#define NAME_LEN sizeof(((tar_header *) 0)->name)
+
+/*
+ * FNV-1a hash of a member name, which may fill the name field without a
+ * null terminator
+ */
+static uint32_t hash_name(const char *name) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < NAME_LEN && name[i] != '\0'; i++) {
+        hash ^= (unsigned char) name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/*
+ * Finds the hash table slot for 'name': either the slot holding its newest
+ * entry or the empty slot where it belongs
+ */
+static int find_slot(const archive_index_t *index, const char *name) {
+    int mask = index->table_size - 1;
+    int slot = hash_name(name) & mask;
+    while (index->newest[slot] != -1) {
+        const char *slot_name = index->entries[index->newest[slot]].header.name;
+        if (strncmp(slot_name, name, NAME_LEN) == 0) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/*
+ * Rebuilds the hash table with room for at least twice the current entries,
+ * keeping the load factor at or below one half
+ * Returns 0 on success or -1 if memory could not be allocated
+ */
+static int rebuild_table(archive_index_t *index) {
+    int table_size = 16;
+    while (table_size < 2 * (index->count + 1)) {
+        table_size *= 2;
+    }
+    int *newest = malloc(table_size * sizeof(int));
+    if (newest == NULL) {
+        perror("Failed to allocate archive index");
+        return -1;
+    }
+    free(index->newest);
+    index->newest = newest;
+    index->table_size = table_size;
+    memset(newest, -1, table_size * sizeof(int));
+
+    // Entries are visited in archive order, so later versions replace earlier ones
+    for (int i = 0; i < index->count; i++) {
+        index->newest[find_slot(index, index->entries[i].header.name)] = i;
+    }
+    return 0;
+}
+
+void archive_index_init(archive_index_t *index) {
+    index->entries = NULL;
+    index->count = 0;
+    index->capacity = 0;
+    index->newest = NULL;
+    index->table_size = 0;
+    index->end_offset = 0;
+}
+
+int archive_index_build(archive_index_t *index, int fd) {
+    archive_index_clear(index);
+
+    off_t pos = 0;
+    archive_entry_t entry;
+    int result;
+    while ((result = read_archive_entry(fd, &pos, &entry)) == 1) {
+        if (index->count == index->capacity) {
+            int capacity = index->capacity == 0 ? INITIAL_CAPACITY : 2 * index->capacity;
+            archive_entry_t *entries = realloc(index->entries, capacity * sizeof(archive_entry_t));
+            if (entries == NULL) {
+                perror("Failed to grow archive index");
+                archive_index_clear(index);
+                return -1;
+            }
+            index->entries = entries;
+            index->capacity = capacity;
+        }
+        index->entries[index->count++] = entry;
+        index->end_offset = pos;
+    }
+    if (result == -1 || rebuild_table(index) != 0) {
+        archive_index_clear(index);
+        return -1;
+    }
+    return 0;
+}
+
+const archive_entry_t *archive_index_find(const archive_index_t *index, const char *name) {
+    if (index->table_size == 0) {
+        return NULL;
+    }
+    int i = index->newest[find_slot(index, name)];
+    return i == -1 ? NULL : &index->entries[i];
+}
+
+int archive_index_is_newest(const archive_index_t *index, int i) {
+    return archive_index_find(index, index->entries[i].header.name) == &index->entries[i];
+}
+
+void archive_index_clear(archive_index_t *index) {
+    free(index->entries);
+    free(index->newest);
+    archive_index_init(index);
+}
@@ -0,0 +1,39 @@
+#ifndef _ARCHIVE_INDEX_H
+#define _ARCHIVE_INDEX_H
+
+#include "minitar.h"
+
+// In-memory table of every member header in an archive, built with one scan
+// Lookups by name return the most recently added version of that file
+typedef struct {
+    // Every member of the archive, in archive order
+    archive_entry_t *entries;
+    int count;
+    int capacity;
+    // Open-addressed hash table mapping names to the index of their newest
+    // entry in 'entries', -1 marks an empty slot
+    int *newest;
+    int table_size;
+    // Offset of the end-of-archive marker, where new members would be written
+    off_t end_offset;
+} archive_index_t;
+
+// Initialize an empty index
+void archive_index_init(archive_index_t *index);
+
+// Scan the archive open as 'fd' and record all of its members in 'index',
+// replacing anything it held before
+// Returns 0 on success or -1 if an error occurs
+int archive_index_build(archive_index_t *index, int fd);
+
+// Get the newest entry for the file named 'name'
+// Returns NULL if no file of that name is present
+const archive_entry_t *archive_index_find(const archive_index_t *index, const char *name);
+
+// Returns 1 if entry 'i' is the newest version of its file, 0 otherwise
+int archive_index_is_newest(const archive_index_t *index, int i);
+
+// Free all memory associated with the index, leaving it empty
+void archive_index_clear(archive_index_t *index);
+
+#endif    // _ARCHIVE_INDEX_H
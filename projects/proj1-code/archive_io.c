@@ -0,0 +1,462 @@
+#define _GNU_SOURCE
+
+#include "archive_io.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <linux/ioprio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "minitar_stats.h"
+
+// Size of the chunks archive writes are gathered into
+#define WRITE_BUF_SIZE (1024 * 1024)
+// Alignment O_DIRECT requires of buffers, file offsets and lengths. This
+// covers the logical block size of any device we expect to write to
+#define DIRECT_ALIGN 4096
+// Throttling waits shorter than this, in seconds, are carried over rather
+// than slept, so sleeps stay few and each I/O request keeps its full size
+#define MIN_THROTTLE_SLEEP 0.05
+// Most credit, in seconds of transfer, an idle rate-limited copy can save up
+#define MAX_THROTTLE_BURST 0.1
+
+static io_options_t io_options;
+
+// Token bucket for the rate limit. 'allowance' is how many bytes may be
+// copied right now and goes negative while a copy is ahead of the limit
+static struct {
+    double allowance;
+    double last_refill;
+} throttle;
+
+void set_io_options(const io_options_t *options) {
+    io_options = *options;
+}
+
+const io_options_t *get_io_options(void) {
+    return &io_options;
+}
+
+int parse_rate(const char *text, unsigned long long *rate) {
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end == text || errno != 0 || value == 0) {
+        return -1;
+    }
+
+    unsigned long long multiplier = 1;
+    if (*end == 'K' || *end == 'k') {
+        multiplier = 1ULL << 10;
+    } else if (*end == 'M' || *end == 'm') {
+        multiplier = 1ULL << 20;
+    } else if (*end == 'G' || *end == 'g') {
+        multiplier = 1ULL << 30;
+    }
+    if (multiplier != 1) {
+        end++;
+    }
+    if (*end == 'B') {
+        end++;
+    }
+    if (strcmp(end, "/s") == 0) {
+        end += 2;
+    }
+    if (*end != '\0' || value > ~0ULL / multiplier) {
+        return -1;
+    }
+
+    *rate = value * multiplier;
+    return 0;
+}
+
+int set_io_priority(const char *text) {
+    int class;
+    int level = IOPRIO_NORM;
+    if (strcmp(text, "idle") == 0) {
+        class = IOPRIO_CLASS_IDLE;
+        level = 0;
+    } else if (strcmp(text, "best-effort") == 0) {
+        class = IOPRIO_CLASS_BE;
+    } else if (strncmp(text, "best-effort:", 12) == 0 && text[12] >= '0' && text[12] <= '7' &&
+               text[13] == '\0') {
+        class = IOPRIO_CLASS_BE;
+        level = text[12] - '0';
+    } else {
+        return -1;
+    }
+
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_PRIO_VALUE(class, level)) != 0) {
+        perror("Failed to set I/O priority");
+        return -1;
+    }
+    return 0;
+}
+
+int parse_durability(const char *text, durability_t *durability) {
+    if (strcmp(text, "none") == 0) {
+        *durability = DURABILITY_NONE;
+    } else if (strcmp(text, "data") == 0) {
+        *durability = DURABILITY_DATA;
+    } else if (strcmp(text, "full") == 0) {
+        *durability = DURABILITY_FULL;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+void io_start_writeback(int fd) {
+    if (io_options.durability != DURABILITY_NONE) {
+        // Queue the writeback now so it overlaps with extracting later files
+        sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+    }
+}
+
+int io_sync_extracted(const char *dir_name) {
+    if (io_options.durability == DURABILITY_NONE) {
+        return 0;
+    }
+    int dir_fd = open(dir_name, O_RDONLY | O_DIRECTORY);
+    if (dir_fd == -1) {
+        perror("Failed to open extraction directory");
+        return -1;
+    }
+    int result = syncfs(dir_fd);
+    if (result != 0) {
+        perror("Failed to sync extracted files");
+    }
+    close(dir_fd);
+    return result;
+}
+
+/*
+ * Flushes the directory containing the file 'path', so a newly created entry
+ * for the file survives a crash
+ * Returns 0 on success or -1 if an error occurs
+ */
+static int sync_parent_dir(const char *path) {
+    char copy[PATH_MAX];
+    if (strlen(path) >= sizeof(copy)) {
+        fprintf(stderr, "Archive path is too long\n");
+        return -1;
+    }
+    strcpy(copy, path);
+    int dir_fd = open(dirname(copy), O_RDONLY | O_DIRECTORY);
+    if (dir_fd == -1) {
+        perror("Failed to open archive directory");
+        return -1;
+    }
+    int result = fsync(dir_fd);
+    if (result != 0) {
+        perror("Failed to sync archive directory");
+    }
+    close(dir_fd);
+    return result;
+}
+
+/*
+ * Waits for everything written to the archive so far to reach storage, as far
+ * as the durability level asks for
+ * Returns 0 on success or -1 if an error occurs
+ */
+static int sync_archive(archive_writer_t *writer) {
+    int result = 0;
+    if (io_options.durability == DURABILITY_DATA) {
+        result = fdatasync(writer->fd);
+    } else if (io_options.durability == DURABILITY_FULL) {
+        result = fsync(writer->fd);
+    }
+    if (result != 0) {
+        perror("Failed to sync archive");
+    }
+    return result;
+}
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void io_throttle(size_t bytes) {
+    if (io_options.rate_limit == 0) {
+        return;
+    }
+    double rate = io_options.rate_limit;
+    double now = monotonic_seconds();
+    if (throttle.last_refill == 0) {
+        throttle.last_refill = now;
+    }
+    throttle.allowance += (now - throttle.last_refill) * rate;
+    if (throttle.allowance > rate * MAX_THROTTLE_BURST) {
+        throttle.allowance = rate * MAX_THROTTLE_BURST;
+    }
+    throttle.last_refill = now;
+
+    throttle.allowance -= bytes;
+    double wait = -throttle.allowance / rate;
+    if (wait < MIN_THROTTLE_SLEEP) {
+        return;
+    }
+    struct timespec ts;
+    ts.tv_sec = (time_t) wait;
+    ts.tv_nsec = (long) ((wait - ts.tv_sec) * 1e9);
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+/*
+ * Turns O_DIRECT on or off for the file open as 'fd'
+ * Returns 0 on success or -1 if the file system refuses
+ */
+static int set_direct(int fd, int enable) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1) {
+        return -1;
+    }
+    flags = enable ? flags | O_DIRECT : flags & ~O_DIRECT;
+    return fcntl(fd, F_SETFL, flags);
+}
+
+/*
+ * Writes the first 'n' buffered bytes to the archive and moves any bytes
+ * after them to the front of the buffer
+ * Returns 0 on success or -1 if an error occurs
+ */
+static int flush_buffer(archive_writer_t *writer, size_t n) {
+    if (writer->hold_first_block && !writer->first_block_held) {
+        // Nothing has been flushed yet, so the whole first block is still
+        // buffered. Zeros go in its place, keeping the old end marker
+        char *first_block = writer->buffer + (writer->start - writer->offset);
+        memcpy(writer->first_block, first_block, BLOCK_SIZE);
+        memset(first_block, 0, BLOCK_SIZE);
+        writer->first_block_held = 1;
+    }
+
+    io_throttle(n);
+    double start = stats_begin();
+    size_t done = 0;
+    while (done < n) {
+        ssize_t bytes_written =
+            pwrite(writer->fd, writer->buffer + done, n - done, writer->offset + done);
+        if (bytes_written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // Some file systems only reject O_DIRECT once it is used
+            if (errno == EINVAL && writer->direct && set_direct(writer->fd, 0) == 0) {
+                writer->direct = 0;
+                continue;
+            }
+            perror("Failed to write archive");
+            return -1;
+        }
+        done += bytes_written;
+    }
+    stats_end(PHASE_ARCHIVE_WRITE, start);
+
+    memmove(writer->buffer, writer->buffer + n, writer->len - n);
+    writer->len -= n;
+    writer->offset += n;
+    return 0;
+}
+
+// Closes the archive and frees the buffer of 'writer' without writing anything
+static void release_writer(archive_writer_t *writer) {
+    close(writer->fd);
+    free(writer->buffer);
+    writer->buffer = NULL;
+}
+
+int archive_writer_open(archive_writer_t *writer, const char *archive_name, int append) {
+    memset(writer, 0, sizeof(*writer));
+    writer->archive_name = archive_name;
+    writer->fd = open(archive_name, append ? O_RDWR : O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (writer->fd == -1) {
+        perror("Failed to open archive");
+        return -1;
+    }
+    if (posix_memalign((void **) &writer->buffer, DIRECT_ALIGN, WRITE_BUF_SIZE) != 0) {
+        perror("Failed to allocate archive buffer");
+        close(writer->fd);
+        return -1;
+    }
+
+    if (append) {
+        struct stat stat_buf;
+        if (fstat(writer->fd, &stat_buf) != 0) {
+            perror("Failed to stat archive");
+            release_writer(writer);
+            return -1;
+        }
+        // New members go where the old trailer starts
+        off_t trailer_size = NUM_TRAILING_BLOCKS * BLOCK_SIZE;
+        writer->offset = stat_buf.st_size > trailer_size ? stat_buf.st_size - trailer_size : 0;
+        writer->hold_first_block = 1;
+    }
+    writer->start = writer->offset;
+
+    if (io_options.low_cache) {
+        // O_DIRECT writes must start on an aligned offset, so the partial
+        // block before the end of an existing archive is read back and
+        // rewritten unchanged
+        size_t head = writer->offset % DIRECT_ALIGN;
+        writer->offset -= head;
+        while (writer->len < head) {
+            ssize_t bytes_read = pread(writer->fd, writer->buffer + writer->len,
+                                       head - writer->len, writer->offset + writer->len);
+            if (bytes_read <= 0) {
+                if (bytes_read == -1 && errno == EINTR) {
+                    continue;
+                }
+                perror("Failed to read archive");
+                release_writer(writer);
+                return -1;
+            }
+            writer->len += bytes_read;
+        }
+        // Not every file system supports O_DIRECT; buffered writes are
+        // still dropped from the cache when the archive is closed
+        writer->direct = set_direct(writer->fd, 1) == 0;
+    }
+    return 0;
+}
+
+int archive_writer_write(archive_writer_t *writer, const void *data, size_t len) {
+    const char *bytes = data;
+    stats_count_write(len);
+    while (len > 0) {
+        size_t space = WRITE_BUF_SIZE - writer->len;
+        size_t n = len < space ? len : space;
+        memcpy(writer->buffer + writer->len, bytes, n);
+        writer->len += n;
+        bytes += n;
+        len -= n;
+        if (writer->len == WRITE_BUF_SIZE && flush_buffer(writer, WRITE_BUF_SIZE) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int archive_writer_copy_fd(archive_writer_t *writer, int src_fd, size_t len) {
+    if (io_options.low_cache) {
+        posix_fadvise(src_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    size_t remaining = len;
+    while (remaining > 0) {
+        size_t space = WRITE_BUF_SIZE - writer->len;
+        size_t n = remaining < space ? remaining : space;
+        double start = stats_begin();
+        ssize_t bytes_read = read(src_fd, writer->buffer + writer->len, n);
+        if (bytes_read == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Failed to read file");
+            return -1;
+        }
+        if (bytes_read == 0) {
+            fprintf(stderr, "File is shorter than its recorded size\n");
+            return -1;
+        }
+        stats_end(PHASE_SOURCE_READ, start);
+        stats_count_read(bytes_read);
+        stats_count_write(bytes_read);
+
+        writer->len += bytes_read;
+        remaining -= bytes_read;
+        if (writer->len == WRITE_BUF_SIZE && flush_buffer(writer, WRITE_BUF_SIZE) != 0) {
+            return -1;
+        }
+    }
+
+    if (io_options.low_cache) {
+        // The source's pages are clean, so they can be dropped right away
+        posix_fadvise(src_fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    return 0;
+}
+
+int archive_writer_close(archive_writer_t *writer) {
+    int result = 0;
+    if (writer->len > 0) {
+        // O_DIRECT can only write whole aligned blocks, so the final partial
+        // block goes through the page cache
+        size_t tail = writer->direct ? writer->len % DIRECT_ALIGN : 0;
+        if (flush_buffer(writer, writer->len - tail) != 0) {
+            result = -1;
+        } else if (tail > 0) {
+            if (set_direct(writer->fd, 0) != 0) {
+                perror("Failed to write archive");
+                result = -1;
+            } else {
+                writer->direct = 0;
+                result = flush_buffer(writer, tail);
+            }
+        }
+    }
+
+    if (result == 0 && writer->first_block_held) {
+        // Only once the rest of the append is on storage does the first new
+        // header replace the old end-of-archive marker
+        if (sync_archive(writer) != 0) {
+            result = -1;
+        } else if (writer->direct && set_direct(writer->fd, 0) != 0) {
+            perror("Failed to write archive");
+            result = -1;
+        } else if (pwrite(writer->fd, writer->first_block, BLOCK_SIZE, writer->start) !=
+                   BLOCK_SIZE) {
+            perror("Failed to write archive");
+            result = -1;
+        }
+    }
+    if (result == 0 && sync_archive(writer) != 0) {
+        result = -1;
+    }
+    if (result == 0 && io_options.durability == DURABILITY_FULL &&
+        sync_parent_dir(writer->archive_name) != 0) {
+        result = -1;
+    }
+
+    if (io_options.low_cache && result == 0) {
+        // Dirty pages can't be dropped, so write back whatever went through
+        // the page cache before asking for it to be evicted
+        sync_file_range(writer->fd, writer->start, 0,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                            SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(writer->fd, writer->start, 0, POSIX_FADV_DONTNEED);
+    }
+
+    if (close(writer->fd) != 0 && result == 0) {
+        perror("Failed to close archive");
+        result = -1;
+    }
+    free(writer->buffer);
+    writer->buffer = NULL;
+    return result;
+}
+
+void archive_writer_discard(archive_writer_t *writer) {
+    if (writer->hold_first_block) {
+        // Put back the trailer that new members were written over
+        char trailer[NUM_TRAILING_BLOCKS * BLOCK_SIZE];
+        memset(trailer, 0, sizeof(trailer));
+        if ((writer->direct && set_direct(writer->fd, 0) != 0) ||
+            pwrite(writer->fd, trailer, sizeof(trailer), writer->start) != sizeof(trailer) ||
+            ftruncate(writer->fd, writer->start + sizeof(trailer)) != 0) {
+            perror("Failed to restore archive");
+        }
+    }
+    release_writer(writer);
+}
@@ -0,0 +1,137 @@
+#ifndef _ARCHIVE_IO_H
+#define _ARCHIVE_IO_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "minitar.h"
+
+// How hard operations work to make what they write survive a crash
+typedef enum {
+    // Leave writeback to the kernel
+    DURABILITY_NONE,
+    // Flush archive or extracted file data to storage before finishing
+    DURABILITY_DATA,
+    // Also flush file metadata and the directory entries naming the files
+    DURABILITY_FULL
+} durability_t;
+
+// How archive operations should treat the rest of the system while they run
+typedef struct {
+    // Keep source files and the archive out of the page cache, so a backup
+    // doesn't evict the working set of other processes on the host
+    int low_cache;
+    // Most bytes per second to copy into or out of an archive, 0 for no limit
+    unsigned long long rate_limit;
+    durability_t durability;
+} io_options_t;
+
+// Use 'options' for every archive operation that follows
+void set_io_options(const io_options_t *options);
+
+// Returns the options set by set_io_options(), all zero by default
+const io_options_t *get_io_options(void);
+
+/*
+ * Parses a rate such as "500K", "20M/s" or "1G" into bytes per second in
+ * 'rate'. Suffixes are powers of 1024.
+ * Returns 0 on success or -1 if 'text' is not a positive rate
+ */
+int parse_rate(const char *text, unsigned long long *rate);
+
+/*
+ * Sets the I/O scheduling class of this process from 'text', which is "idle",
+ * "best-effort" or "best-effort:N" with N from 0 (highest) to 7
+ * Returns 0 on success or -1 if 'text' is malformed or the kernel refuses
+ */
+int set_io_priority(const char *text);
+
+/*
+ * Parses "none", "data" or "full" into 'durability'
+ * Returns 0 on success or -1 if 'text' is not a durability level
+ */
+int parse_durability(const char *text, durability_t *durability);
+
+/*
+ * Starts writing back the data of the extracted file open as 'fd' without
+ * waiting for it, if extraction is meant to be durable. Call once the file is
+ * fully written; io_sync_extracted() then waits for every file at once
+ */
+void io_start_writeback(int fd);
+
+/*
+ * Waits until everything extracted into the directory 'dir_name' is on
+ * storage, if extraction is meant to be durable. A single syncfs() covers
+ * the data, metadata and directory entries of every file extracted
+ * Returns 0 on success or -1 if an error occurs
+ */
+int io_sync_extracted(const char *dir_name);
+
+/*
+ * Accounts for 'bytes' copied into or out of an archive, sleeping
+ * as needed to stay under the rate limit. Short waits are carried over until
+ * they add up to one worthwhile sleep, so throttling never splits I/O into
+ * smaller requests
+ */
+void io_throttle(size_t bytes);
+
+// Gathers writes to an archive into large buffered chunks
+typedef struct {
+    int fd;
+    char *buffer;
+    size_t len;       // Bytes waiting in 'buffer'
+    off_t offset;     // Archive offset that buffer[0] will be written to
+    off_t start;      // Archive offset where this writer started writing
+    int direct;       // Whether 'fd' is currently open with O_DIRECT
+    const char *archive_name;
+    // When appending, the first block written replaces the first block of
+    // the old trailer. It is held back here and written last, so until the
+    // append is complete the archive still ends where it did before
+    int hold_first_block;
+    int first_block_held;
+    char first_block[BLOCK_SIZE];
+} archive_writer_t;
+
+/*
+ * Opens the archive identified by 'archive_name' for writing through 'writer'.
+ * If 'append' is nonzero writes replace the trailer at the end of the archive,
+ * otherwise the archive is created or truncated.
+ * In low-cache mode the archive is written with O_DIRECT where the file system
+ * supports it.
+ * Returns 0 on success or -1 if an error occurs
+ */
+int archive_writer_open(archive_writer_t *writer, const char *archive_name, int append);
+
+/*
+ * Writes 'len' bytes at 'data' to the archive after everything written so far
+ * Returns 0 on success or -1 if an error occurs
+ */
+int archive_writer_write(archive_writer_t *writer, const void *data, size_t len);
+
+/*
+ * Copies exactly 'len' bytes from the start of the file open as 'src_fd' to
+ * the archive, reading straight into the writer's buffer.
+ * In low-cache mode the source is read sequentially and its pages are
+ * dropped from the page cache once copied.
+ * Returns 0 on success or -1 if an error occurs or the file is shorter
+ */
+int archive_writer_copy_fd(archive_writer_t *writer, int src_fd, size_t len);
+
+/*
+ * Writes out everything still buffered, with the final partial block written
+ * through the page cache if O_DIRECT was in use, and closes the archive.
+ * When appending, the held-back first block is written only after everything
+ * else has reached storage, if the durability level calls for syncing.
+ * The writer's resources are released even if an error occurs.
+ * Returns 0 on success or -1 if an error occurs
+ */
+int archive_writer_close(archive_writer_t *writer);
+
+/*
+ * Abandons a write after an error and closes the archive. An archive being
+ * appended to is restored to its original contents; a new archive is left
+ * as it is
+ */
+void archive_writer_discard(archive_writer_t *writer);
+
+#endif    // _ARCHIVE_IO_H
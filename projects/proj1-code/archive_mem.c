@@ -0,0 +1,247 @@
+#include "archive_mem.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MIN_CAPACITY (64 * 1024)
+#define COPY_BUF_SIZE (64 * 1024)
+#define MAX_MSG_LEN 128
+
+static const char zero_block[BLOCK_SIZE];
+
+/*
+ * Makes sure the builder's buffer has room for 'extra' more bytes,
+ * at least doubling its capacity whenever it has to grow
+ * Returns 0 on success or -1 if memory could not be allocated
+ */
+static int reserve(archive_builder_t *builder, size_t extra) {
+    if (builder->capacity - builder->len >= extra) {
+        return 0;
+    }
+    size_t capacity = builder->capacity == 0 ? MIN_CAPACITY : builder->capacity;
+    while (capacity - builder->len < extra) {
+        capacity *= 2;
+    }
+    char *data = realloc(builder->data, capacity);
+    if (data == NULL) {
+        perror("Failed to grow archive buffer");
+        return -1;
+    }
+    builder->data = data;
+    builder->capacity = capacity;
+    return 0;
+}
+
+/*
+ * Sends 'len' bytes at 'data' to the builder's output
+ * Returns 0 on success or -1 if an error occurs
+ */
+static int emit(archive_builder_t *builder, const void *data, size_t len) {
+    if (builder->write_fn != NULL) {
+        return builder->write_fn(builder->write_ctx, data, len);
+    }
+    if (reserve(builder, len) != 0) {
+        return -1;
+    }
+    memcpy(builder->data + builder->len, data, len);
+    builder->len += len;
+    return 0;
+}
+
+/*
+ * Pads the output with zeros so that a member body of 'size' bytes
+ * fills a whole number of blocks
+ */
+static int emit_padding(archive_builder_t *builder, size_t size) {
+    size_t remainder = size % BLOCK_SIZE;
+    if (remainder == 0) {
+        return 0;
+    }
+    return emit(builder, zero_block, BLOCK_SIZE - remainder);
+}
+
+void archive_builder_init(archive_builder_t *builder) {
+    builder->data = NULL;
+    builder->len = 0;
+    builder->capacity = 0;
+    builder->write_fn = NULL;
+    builder->write_ctx = NULL;
+}
+
+void archive_builder_init_callback(archive_builder_t *builder, archive_write_fn write_fn,
+                                   void *ctx) {
+    archive_builder_init(builder);
+    builder->write_fn = write_fn;
+    builder->write_ctx = ctx;
+}
+
+int archive_builder_add_file(archive_builder_t *builder, const char *file_name) {
+    char err_msg[MAX_MSG_LEN];
+    int fd = open(file_name, O_RDONLY);
+    if (fd == -1) {
+        snprintf(err_msg, MAX_MSG_LEN, "Failed to open file %s", file_name);
+        perror(err_msg);
+        return -1;
+    }
+
+    struct stat stat_buf;
+    tar_header header;
+    if (fstat(fd, &stat_buf) != 0) {
+        snprintf(err_msg, MAX_MSG_LEN, "Failed to stat file %s", file_name);
+        perror(err_msg);
+        close(fd);
+        return -1;
+    }
+    // fill_tar_header_from_stat already prints out any errors
+    if (fill_tar_header_from_stat(&header, file_name, &stat_buf) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    // A failure from here on leaves part of the member behind, which is
+    // dropped again from a memory buffer so later members stay aligned
+    size_t start = builder->len;
+    size_t size = stat_buf.st_size;
+    size_t padded = (size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+    char *chunk = NULL;
+    int result = 0;
+    if (emit(builder, &header, sizeof(tar_header)) != 0) {
+        snprintf(err_msg, MAX_MSG_LEN, "Failed to add header for file %s", file_name);
+        perror(err_msg);
+        result = -1;
+    } else if (builder->write_fn == NULL) {
+        // Read straight into the archive buffer so the body is copied only once
+        result = reserve(builder, padded);
+    } else {
+        chunk = malloc(COPY_BUF_SIZE);
+        if (chunk == NULL) {
+            perror("Failed to allocate copy buffer");
+            result = -1;
+        }
+    }
+
+    size_t bytes_remain = size;
+    while (result == 0 && bytes_remain > 0) {
+        char *dest = chunk != NULL ? chunk : builder->data + builder->len;
+        size_t bytes_to_read = chunk != NULL && bytes_remain > COPY_BUF_SIZE ? COPY_BUF_SIZE
+                                                                              : bytes_remain;
+        ssize_t bytes_read = read(fd, dest, bytes_to_read);
+        if (bytes_read <= 0) {
+            if (bytes_read == 0) {
+                errno = EIO;    // file is shorter than it was when stat'ed
+            }
+            snprintf(err_msg, MAX_MSG_LEN, "Failed to read file %s", file_name);
+            perror(err_msg);
+            result = -1;
+            break;
+        }
+        if (chunk != NULL) {
+            if (emit(builder, chunk, bytes_read) != 0) {
+                perror("Failed to write member data");
+                result = -1;
+                break;
+            }
+        } else {
+            builder->len += bytes_read;
+        }
+        bytes_remain -= bytes_read;
+    }
+    if (result == 0) {
+        result = emit_padding(builder, size);
+    }
+
+    free(chunk);
+    close(fd);
+    if (result != 0 && builder->write_fn == NULL) {
+        builder->len = start;
+    }
+    return result;
+}
+
+int archive_builder_add_buffer(archive_builder_t *builder, const char *member_name,
+                               const void *data, size_t len, mode_t mode, time_t mtime) {
+    // Describe the buffer as if it were a regular file owned by the caller
+    struct stat stat_buf;
+    memset(&stat_buf, 0, sizeof(stat_buf));
+    stat_buf.st_mode = S_IFREG | (mode & 07777);
+    stat_buf.st_uid = getuid();
+    stat_buf.st_gid = getgid();
+    stat_buf.st_size = len;
+    stat_buf.st_mtime = mtime;
+
+    tar_header header;
+    if (fill_tar_header_from_stat(&header, member_name, &stat_buf) != 0) {
+        return -1;
+    }
+    size_t start = builder->len;
+    if (emit(builder, &header, sizeof(tar_header)) != 0 || emit(builder, data, len) != 0 ||
+        emit_padding(builder, len) != 0) {
+        perror("Failed to add buffer to archive");
+        if (builder->write_fn == NULL) {
+            builder->len = start;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+int archive_builder_finish(archive_builder_t *builder) {
+    for (int i = 0; i < NUM_TRAILING_BLOCKS; i++) {
+        if (emit(builder, zero_block, BLOCK_SIZE) != 0) {
+            perror("Failed to write archive termination blocks");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void archive_builder_free(archive_builder_t *builder) {
+    free(builder->data);
+    builder->data = NULL;
+    builder->len = 0;
+    builder->capacity = 0;
+}
+
+void archive_reader_init(archive_reader_t *reader, const void *data, size_t len) {
+    reader->base = data;
+    reader->len = len;
+    reader->pos = 0;
+}
+
+int archive_reader_next(archive_reader_t *reader, archive_member_t *member) {
+    size_t remaining = reader->len - reader->pos;
+    if (remaining == 0) {
+        return 0;
+    }
+    if (remaining < BLOCK_SIZE) {
+        return -1;
+    }
+
+    const tar_header *header = (const tar_header *) (reader->base + reader->pos);
+    if (is_zero_block(header)) {
+        return 0;
+    }
+
+    size_t size;
+    if (get_header_size(header, &size) != 0 || size > remaining - BLOCK_SIZE) {
+        return -1;
+    }
+
+    member->header = header;
+    member->data = reader->base + reader->pos + BLOCK_SIZE;
+    member->size = size;
+    member->header_offset = reader->pos;
+
+    // The final member's padding may be missing if the archive was cut short
+    size_t padded = (size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+    if (padded > remaining - BLOCK_SIZE) {
+        padded = remaining - BLOCK_SIZE;
+    }
+    reader->pos += BLOCK_SIZE + padded;
+    return 1;
+}
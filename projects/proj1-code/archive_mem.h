@@ -0,0 +1,81 @@
+#ifndef _ARCHIVE_MEM_H
+#define _ARCHIVE_MEM_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "minitar.h"
+
+// Callback that receives each chunk of archive bytes produced by a builder
+// Should return 0 on success or -1 if the bytes could not be consumed
+typedef int (*archive_write_fn)(void *ctx, const void *data, size_t len);
+
+// Builds a tar archive in memory rather than in a named file on disk
+// Output either accumulates in a growable buffer ('data'/'len') or is handed
+// to a caller-supplied write callback as it is produced
+typedef struct {
+    char *data;
+    size_t len;
+    size_t capacity;
+    archive_write_fn write_fn;
+    void *write_ctx;
+} archive_builder_t;
+
+// One member of an archive, as produced by a reader
+typedef struct {
+    // Points at the member's header block inside the archive buffer
+    const tar_header *header;
+    // Points at the first byte of the member's body inside the archive buffer
+    const void *data;
+    // Size of the member's body in bytes
+    size_t size;
+    // Offset of the member's header block from the start of the archive
+    off_t header_offset;
+} archive_member_t;
+
+// Iterates over the members of an archive held in memory, in place
+typedef struct {
+    const char *base;
+    size_t len;
+    size_t pos;
+} archive_reader_t;
+
+// Initialize a builder whose output accumulates in a growable memory buffer
+void archive_builder_init(archive_builder_t *builder);
+
+// Initialize a builder that passes all output to 'write_fn' along with 'ctx'
+void archive_builder_init_callback(archive_builder_t *builder, archive_write_fn write_fn,
+                                   void *ctx);
+
+// Add the file on disk identified by 'file_name' as a new member
+// Returns 0 on success or -1 if an error occurs. On error a memory buffer is
+// left as it was, but a callback may already have been given part of the
+// member, so the callback's output should then be discarded
+int archive_builder_add_file(archive_builder_t *builder, const char *file_name);
+
+// Add 'len' bytes at 'data' as a new member named 'member_name' with
+// permission bits 'mode' and modification time 'mtime'
+// Returns 0 on success or -1 if an error occurs, with the same guarantees as
+// archive_builder_add_file()
+int archive_builder_add_buffer(archive_builder_t *builder, const char *member_name,
+                               const void *data, size_t len, mode_t mode, time_t mtime);
+
+// Write the end-of-archive marker. No members may be added afterwards
+// Returns 0 on success or -1 if an error occurs
+int archive_builder_finish(archive_builder_t *builder);
+
+// Free the builder's buffer. The builder may be re-initialized afterwards
+void archive_builder_free(archive_builder_t *builder);
+
+// Initialize a reader over the 'len' bytes of archive data at 'data'
+// The data must stay valid, and unmodified, while members are in use
+void archive_reader_init(archive_reader_t *reader, const void *data, size_t len);
+
+// Advance to the next member, filling in 'member' with pointers into the
+// archive data. No member bytes are copied
+// Returns 1 if a member was found, 0 at the end of the archive, or -1 if the
+// archive is malformed
+int archive_reader_next(archive_reader_t *reader, archive_member_t *member);
+
+#endif    // _ARCHIVE_MEM_H
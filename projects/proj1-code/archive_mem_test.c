@@ -0,0 +1,222 @@
+// archive_mem_test.c: builds an archive in memory from an in-memory buffer and
+// files on disk, writes it out so 'minitar' and 'tar' can check it, then reads
+// it back with the in-memory reader and compares every member's body with the
+// data it was built from. The same archive is also built through a write
+// callback, which must produce exactly the same bytes. Finally, members that
+// fail to be added must leave nothing behind in a memory buffer.
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "archive_mem.h"
+
+#define MEMORY_MEMBER_NAME "memory.txt"
+#define MEMORY_MEMBER_MTIME 1700000000
+
+static const char memory_member[] = "This member was never a file on disk.\n";
+
+/*
+ * Write callback that appends every chunk to the file descriptor in 'ctx'
+ */
+static int write_to_fd(void *ctx, const void *data, size_t len) {
+    int fd = *(int *) ctx;
+    const char *bytes = data;
+    while (len > 0) {
+        ssize_t written = write(fd, bytes, len);
+        if (written <= 0) {
+            return -1;
+        }
+        bytes += written;
+        len -= written;
+    }
+    return 0;
+}
+
+/*
+ * Adds the in-memory member followed by each of the 'num_files' named files,
+ * then finishes the archive
+ * Returns 0 on success or -1 if an error occurs
+ */
+static int build(archive_builder_t *builder, char **file_names, int num_files) {
+    if (archive_builder_add_buffer(builder, MEMORY_MEMBER_NAME, memory_member,
+                                   strlen(memory_member), 0644, MEMORY_MEMBER_MTIME) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < num_files; i++) {
+        if (archive_builder_add_file(builder, file_names[i]) != 0) {
+            return -1;
+        }
+    }
+    return archive_builder_finish(builder);
+}
+
+/*
+ * Reads the whole file identified by 'file_name' into a new buffer
+ * Returns the buffer, with its length in '*len', or NULL if an error occurs
+ */
+static char *read_whole_file(const char *file_name, size_t *len) {
+    int fd = open(file_name, O_RDONLY);
+    if (fd == -1) {
+        perror("Failed to open file");
+        return NULL;
+    }
+    struct stat stat_buf;
+    if (fstat(fd, &stat_buf) != 0) {
+        perror("Failed to stat file");
+        close(fd);
+        return NULL;
+    }
+    // One extra byte so an empty file still gets a buffer
+    char *data = malloc(stat_buf.st_size + 1);
+    if (data == NULL) {
+        perror("Failed to allocate file buffer");
+        close(fd);
+        return NULL;
+    }
+    size_t total = 0;
+    while (total < (size_t) stat_buf.st_size) {
+        ssize_t bytes_read = read(fd, data + total, stat_buf.st_size - total);
+        if (bytes_read <= 0) {
+            perror("Failed to read file");
+            free(data);
+            close(fd);
+            return NULL;
+        }
+        total += bytes_read;
+    }
+    close(fd);
+    *len = total;
+    return data;
+}
+
+/*
+ * Walks the archive in 'data' with the reader, printing one line per member
+ * and comparing each body with the buffer or file it was built from
+ * Returns the number of members that did not match, or -1 if an error occurs
+ */
+static int check_members(const char *data, size_t len, char **file_names, int num_files) {
+    archive_reader_t reader;
+    archive_member_t member;
+    archive_reader_init(&reader, data, len);
+    int mismatches = 0;
+    int num_members = 0;
+    int found;
+    while ((found = archive_reader_next(&reader, &member)) == 1) {
+        const char *expected_name = NULL;
+        if (num_members <= num_files) {
+            expected_name = num_members == 0 ? MEMORY_MEMBER_NAME : file_names[num_members - 1];
+        }
+        if (expected_name == NULL || strcmp(member.header->name, expected_name) != 0) {
+            printf("Unexpected member %.100s\n", member.header->name);
+            return -1;
+        }
+
+        size_t expected_len = strlen(memory_member);
+        char *expected = num_members == 0 ? (char *) memory_member
+                                          : read_whole_file(expected_name, &expected_len);
+        if (expected == NULL) {
+            return -1;
+        }
+        int matches =
+            member.size == expected_len && memcmp(member.data, expected, expected_len) == 0;
+        printf("%s: %zu bytes, %s\n", expected_name, member.size, matches ? "matches" : "DIFFERS");
+        mismatches += !matches;
+        if (num_members > 0) {
+            free(expected);
+        }
+        num_members++;
+    }
+    if (found == -1) {
+        printf("Archive is malformed\n");
+        return -1;
+    }
+    if (num_members != num_files + 1) {
+        printf("Archive has %d members, expected %d\n", num_members, num_files + 1);
+        return -1;
+    }
+    return mismatches;
+}
+
+/*
+ * Tries to add a file that doesn't exist and a directory, whose header is
+ * written before reading it fails, then adds 'file_name' and checks that the
+ * archive holds only the good members
+ * Returns 0 on success or -1 if the failed members left anything behind
+ */
+static int check_failed_adds(char *file_name) {
+    archive_builder_t builder;
+    archive_builder_init(&builder);
+    int result = archive_builder_add_buffer(&builder, MEMORY_MEMBER_NAME, memory_member,
+                                            strlen(memory_member), 0644, MEMORY_MEMBER_MTIME);
+    if (result == 0 && (archive_builder_add_file(&builder, "missing.txt") == 0 ||
+                        archive_builder_add_file(&builder, "test_cases") == 0)) {
+        printf("Adding a bad file succeeded\n");
+        result = -1;
+    }
+    if (result == 0 && archive_builder_add_file(&builder, file_name) == 0 &&
+        archive_builder_finish(&builder) == 0) {
+        result = check_members(builder.data, builder.len, &file_name, 1);
+    }
+    archive_builder_free(&builder);
+    return result == 0 ? 0 : -1;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("Usage: %s <archive> [FILE]...\n", argv[0]);
+        return 1;
+    }
+    char **file_names = &argv[2];
+    int num_files = argc - 2;
+
+    archive_builder_t builder;
+    archive_builder_init(&builder);
+    if (build(&builder, file_names, num_files) != 0) {
+        archive_builder_free(&builder);
+        return 1;
+    }
+
+    // Build the archive again straight into the output file
+    int fd = open(argv[1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror("Failed to open archive file");
+        archive_builder_free(&builder);
+        return 1;
+    }
+    archive_builder_t file_builder;
+    archive_builder_init_callback(&file_builder, write_to_fd, &fd);
+    int result = build(&file_builder, file_names, num_files);
+    archive_builder_free(&file_builder);
+    if (close(fd) != 0 && result == 0) {
+        perror("Failed to write archive file");
+        result = -1;
+    }
+    if (result != 0) {
+        archive_builder_free(&builder);
+        return 1;
+    }
+
+    size_t written_len;
+    char *written = read_whole_file(argv[1], &written_len);
+    if (written == NULL) {
+        archive_builder_free(&builder);
+        return 1;
+    }
+    if (written_len != builder.len || memcmp(written, builder.data, builder.len) != 0) {
+        printf("Callback output differs from buffer output\n");
+        result = -1;
+    }
+    free(written);
+
+    if (result == 0) {
+        result = check_members(builder.data, builder.len, file_names, num_files);
+    }
+    archive_builder_free(&builder);
+    if (result == 0 && num_files > 0) {
+        result = check_failed_adds(file_names[0]);
+    }
+    return result == 0 ? 0 : 1;
+}
@@ -0,0 +1,328 @@
+#define _GNU_SOURCE
+
+#include "archive_search.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "archive_index.h"
+#include "minitar.h"
+
+#define MAX_SEARCH_THREADS 8
+// Members larger than this are split into pieces of about this size, ending
+// on line boundaries, so one large file can keep every thread busy
+#define SEARCH_CHUNK_SIZE (4 * 1024 * 1024)
+#define NAME_LEN sizeof(((tar_header *) 0)->name)
+
+// One matching line, pointing into the mapped archive
+typedef struct {
+    // Lines before this one within its chunk
+    size_t line;
+    // Offset of the start of the line within its member
+    size_t offset;
+    const char *text;
+    size_t len;
+} search_match_t;
+
+// A run of whole lines from one member, searched by a single thread
+typedef struct {
+    const archive_entry_t *entry;
+    // The chunk's bytes inside the mapped archive
+    const char *data;
+    size_t len;
+    // Offset of the chunk's first byte within its member
+    size_t member_offset;
+    // Filled in by the search: every matching line, and the number of
+    // newlines in the chunk so later chunks can number their lines
+    search_match_t *matches;
+    int num_matches;
+    int capacity;
+    size_t num_newlines;
+    int failed;
+} search_chunk_t;
+
+// Queue of chunks shared by the worker threads
+typedef struct {
+    search_chunk_t *chunks;
+    int num_chunks;
+    int next;
+    const char *pattern;
+    size_t pattern_len;
+    pthread_mutex_t lock;
+} search_work_t;
+
+/*
+ * Counts the newline characters in the 'len' bytes at 'data'
+ */
+static size_t count_newlines(const char *data, size_t len) {
+    size_t count = 0;
+    const char *end = data + len;
+    while ((data = memchr(data, '\n', end - data)) != NULL) {
+        count++;
+        data++;
+    }
+    return count;
+}
+
+/*
+ * Records a matching line in 'chunk'
+ * Returns 0 on success or -1 if memory could not be allocated
+ */
+static int add_match(search_chunk_t *chunk, size_t line, const char *text, size_t len) {
+    if (chunk->num_matches == chunk->capacity) {
+        int capacity = chunk->capacity > 0 ? 2 * chunk->capacity : 16;
+        search_match_t *matches = realloc(chunk->matches, capacity * sizeof(search_match_t));
+        if (matches == NULL) {
+            return -1;
+        }
+        chunk->matches = matches;
+        chunk->capacity = capacity;
+    }
+    search_match_t *match = &chunk->matches[chunk->num_matches++];
+    match->line = line;
+    match->offset = chunk->member_offset + (text - chunk->data);
+    match->text = text;
+    match->len = len;
+    return 0;
+}
+
+/*
+ * Finds every line of 'chunk' containing the pattern. memmem() skips straight
+ * from one occurrence to the next, and newlines are only counted, with
+ * memchr(), up to each line that matches
+ */
+static void search_chunk(search_chunk_t *chunk, const char *pattern, size_t pattern_len) {
+    const char *end = chunk->data + chunk->len;
+    const char *line_start = chunk->data;
+    size_t line = 0;
+    while (line_start < end) {
+        const char *match = memmem(line_start, end - line_start, pattern, pattern_len);
+        if (match == NULL) {
+            break;
+        }
+        // Move up to the start of the line holding the match
+        const char *newline;
+        while ((newline = memchr(line_start, '\n', match - line_start)) != NULL) {
+            line++;
+            line_start = newline + 1;
+        }
+        const char *line_end = memchr(match, '\n', end - match);
+        if (line_end == NULL) {
+            line_end = end;
+        }
+        if (add_match(chunk, line, line_start, line_end - line_start) != 0) {
+            chunk->failed = 1;
+            return;
+        }
+        if (line_end == end) {
+            line_start = end;
+            break;
+        }
+        line++;
+        line_start = line_end + 1;
+    }
+    chunk->num_newlines = line + count_newlines(line_start, end - line_start);
+}
+
+/*
+ * Thread start routine: takes chunks off the shared queue until it is empty
+ */
+static void *search_worker(void *arg) {
+    search_work_t *work = arg;
+    while (1) {
+        pthread_mutex_lock(&work->lock);
+        int i = work->next++;
+        pthread_mutex_unlock(&work->lock);
+        if (i >= work->num_chunks) {
+            return NULL;
+        }
+        search_chunk(&work->chunks[i], work->pattern, work->pattern_len);
+    }
+}
+
+/*
+ * Searches all 'num_chunks' chunks, spread over up to MAX_SEARCH_THREADS threads
+ */
+static void run_search(search_chunk_t *chunks, int num_chunks, const char *pattern) {
+    search_work_t work;
+    work.chunks = chunks;
+    work.num_chunks = num_chunks;
+    work.next = 0;
+    work.pattern = pattern;
+    work.pattern_len = strlen(pattern);
+    pthread_mutex_init(&work.lock, NULL);
+
+    long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_threads > MAX_SEARCH_THREADS) {
+        num_threads = MAX_SEARCH_THREADS;
+    }
+    if (num_threads > num_chunks) {
+        num_threads = num_chunks;
+    }
+
+    pthread_t threads[MAX_SEARCH_THREADS];
+    int num_started = 0;
+    for (int i = 0; i < num_threads; i++) {
+        if (pthread_create(&threads[i], NULL, search_worker, &work) != 0) {
+            break;
+        }
+        num_started++;
+    }
+    // Finish whatever is left on this thread if none could be started
+    if (num_started == 0) {
+        search_worker(&work);
+    }
+    for (int i = 0; i < num_started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&work.lock);
+}
+
+/*
+ * Appends the chunks covering the body of 'entry', which starts at 'data', to
+ * '*chunks', growing the array as needed
+ * Returns 0 on success or -1 if memory could not be allocated
+ */
+static int add_chunks(search_chunk_t **chunks, int *num_chunks, int *capacity,
+                      const archive_entry_t *entry, const char *data) {
+    size_t pos = 0;
+    do {
+        size_t end = entry->size;
+        if (end - pos > SEARCH_CHUNK_SIZE) {
+            // Extend the chunk to the end of the line it would cut in two
+            const char *newline = memchr(data + pos + SEARCH_CHUNK_SIZE, '\n',
+                                         entry->size - pos - SEARCH_CHUNK_SIZE);
+            end = newline != NULL ? newline - data + 1 : entry->size;
+        }
+
+        if (*num_chunks == *capacity) {
+            int new_capacity = *capacity > 0 ? 2 * *capacity : 64;
+            search_chunk_t *grown = realloc(*chunks, new_capacity * sizeof(search_chunk_t));
+            if (grown == NULL) {
+                perror("Failed to allocate search queue");
+                return -1;
+            }
+            *chunks = grown;
+            *capacity = new_capacity;
+        }
+        search_chunk_t *chunk = &(*chunks)[(*num_chunks)++];
+        memset(chunk, 0, sizeof(*chunk));
+        chunk->entry = entry;
+        chunk->data = data + pos;
+        chunk->len = end - pos;
+        chunk->member_offset = pos;
+        pos = end;
+    } while (pos < entry->size);
+    return 0;
+}
+
+int search_archive(const char *archive_name, const char *pattern, const file_list_t *files,
+                   int *num_matches) {
+    *num_matches = 0;
+    if (pattern[0] == '\0' || strchr(pattern, '\n') != NULL) {
+        fprintf(stderr, "Search pattern must be a non-empty string without newlines\n");
+        return -1;
+    }
+
+    int archive_fd = open(archive_name, O_RDONLY);
+    if (archive_fd == -1) {
+        perror("cannot open archive file");
+        return -1;
+    }
+    struct stat stat_buf;
+    if (fstat(archive_fd, &stat_buf) != 0) {
+        perror("Failed to stat archive");
+        close(archive_fd);
+        return -1;
+    }
+    archive_index_t index;
+    archive_index_init(&index);
+    if (archive_index_build(&index, archive_fd) != 0) {
+        close(archive_fd);
+        return -1;
+    }
+
+    const char *base = NULL;
+    if (stat_buf.st_size > 0) {
+        base = mmap(NULL, stat_buf.st_size, PROT_READ, MAP_PRIVATE, archive_fd, 0);
+        if (base == MAP_FAILED) {
+            perror("Failed to map archive");
+            archive_index_clear(&index);
+            close(archive_fd);
+            return -1;
+        }
+    }
+    close(archive_fd);
+
+    // Either the named files or the newest version of every archived file
+    int result = 0;
+    search_chunk_t *chunks = NULL;
+    int num_chunks = 0;
+    int capacity = 0;
+    for (int i = 0; i < index.count && result == 0; i++) {
+        const archive_entry_t *entry = &index.entries[i];
+        if (!archive_index_is_newest(&index, i)) {
+            continue;
+        }
+        if (files->size > 0) {
+            char name[NAME_LEN + 1];
+            snprintf(name, sizeof(name), "%.*s", (int) NAME_LEN, entry->header.name);
+            if (!file_list_contains(files, name)) {
+                continue;
+            }
+        }
+        if (entry->data_offset + (off_t) entry->size > stat_buf.st_size) {
+            fprintf(stderr, "Archive ends in the middle of a member\n");
+            result = -1;
+        } else if (entry->size > 0) {
+            result = add_chunks(&chunks, &num_chunks, &capacity, entry, base + entry->data_offset);
+        }
+    }
+    for (node_t *current = files->head; current != NULL; current = current->next) {
+        if (archive_index_find(&index, current->name) == NULL) {
+            fprintf(stderr, "%s: Not found in archive\n", current->name);
+            result = -1;
+        }
+    }
+
+    if (result == 0) {
+        run_search(chunks, num_chunks, pattern);
+    }
+
+    // Report in archive order once every chunk has been searched, numbering
+    // lines from the start of each member
+    size_t lines_before = 0;
+    for (int i = 0; i < num_chunks; i++) {
+        const search_chunk_t *chunk = &chunks[i];
+        if (i > 0 && chunks[i - 1].entry != chunk->entry) {
+            lines_before = 0;
+        }
+        if (chunk->failed) {
+            fprintf(stderr, "Failed to allocate search results\n");
+            result = -1;
+        }
+        for (int j = 0; j < chunk->num_matches; j++) {
+            const search_match_t *match = &chunk->matches[j];
+            printf("%.*s:%zu:%zu:", (int) NAME_LEN, chunk->entry->header.name,
+                   lines_before + match->line + 1, match->offset);
+            fwrite(match->text, 1, match->len, stdout);
+            putchar('\n');
+        }
+        *num_matches += chunk->num_matches;
+        lines_before += chunk->num_newlines;
+        free(chunk->matches);
+    }
+
+    free(chunks);
+    if (base != NULL) {
+        munmap((void *) base, stat_buf.st_size);
+    }
+    archive_index_clear(&index);
+    return result;
+}
@@ -0,0 +1,21 @@
+#ifndef _ARCHIVE_SEARCH_H
+#define _ARCHIVE_SEARCH_H
+
+#include "file_list.h"
+
+/*
+ * Search the newest version of each file in the archive identified by
+ * 'archive_name' for lines containing 'pattern', printing every matching line
+ * as NAME:LINE:OFFSET:TEXT. LINE counts from 1 and OFFSET is the byte offset
+ * of the start of the line within the file.
+ * If 'files' is not empty, only the files it names are searched.
+ * Member contents are searched in place through a memory mapping of the
+ * archive, with large members split into pieces, and the work is spread over
+ * several threads. Results are still printed in archive order.
+ * The number of matching lines is stored in 'num_matches'.
+ * This function should return 0 upon success or -1 if an error occurred.
+ */
+int search_archive(const char *archive_name, const char *pattern, const file_list_t *files,
+                   int *num_matches);
+
+#endif    // _ARCHIVE_SEARCH_H
@@ -0,0 +1,522 @@
+#define _GNU_SOURCE
+
+#include "archive_server.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "archive_index.h"
+#include "minitar.h"
+
+// Archives whose indexes are kept in memory at once; the least recently
+// used one is dropped to make room for another
+#define MAX_CACHED_ARCHIVES 64
+#define NAME_LEN sizeof(((tar_header *) 0)->name)
+// A request is an operation byte, an archive path and a member name, with
+// the path and name each followed by a null byte
+#define MAX_REQUEST_LEN (1 + PATH_MAX + NAME_LEN + 1)
+#define MAX_STATUS_LEN 256
+#define LISTEN_BACKLOG 64
+// Seconds a client may take to send its request or accept the response
+#define CLIENT_TIMEOUT 5
+#define IO_BUF_SIZE (64 * 1024)
+// inotify events that mean an archive's cached index no longer matches it
+#define ARCHIVE_EVENTS (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF)
+
+typedef struct {
+    char path[PATH_MAX];
+    int fd;    // -1 if this slot is unused
+    int watch;
+    archive_index_t index;
+    unsigned long last_used;
+} cached_archive_t;
+
+typedef struct {
+    cached_archive_t archives[MAX_CACHED_ARCHIVES];
+    int inotify_fd;
+    unsigned long requests;
+} server_t;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int signal) {
+    stop_requested = 1;
+}
+
+/*
+ * Writes all 'len' bytes at 'buf' to 'fd', retrying after short writes
+ * Returns 0 on success or -1 if an error occurs
+ */
+static int write_all(int fd, const void *buf, size_t len) {
+    const char *bytes = buf;
+    while (len > 0) {
+        ssize_t bytes_written = write(fd, bytes, len);
+        if (bytes_written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        bytes += bytes_written;
+        len -= bytes_written;
+    }
+    return 0;
+}
+
+// Stop watching through 'watch' unless a cached archive other than 'except'
+// still relies on it. Paths naming the same file share one watch
+static void release_watch(server_t *server, int watch, const cached_archive_t *except) {
+    for (int i = 0; i < MAX_CACHED_ARCHIVES; i++) {
+        const cached_archive_t *archive = &server->archives[i];
+        if (archive != except && archive->fd != -1 && archive->watch == watch) {
+            return;
+        }
+    }
+    // Fails harmlessly if the kernel already removed the watch
+    inotify_rm_watch(server->inotify_fd, watch);
+}
+
+// Forget the index of 'archive' and stop watching it
+static void evict_archive(server_t *server, cached_archive_t *archive) {
+    if (archive->fd == -1) {
+        return;
+    }
+    release_watch(server, archive->watch, archive);
+    close(archive->fd);
+    archive_index_clear(&archive->index);
+    archive->fd = -1;
+}
+
+/*
+ * Finds the cached index of the archive at the absolute path 'path', scanning
+ * the archive if it isn't cached yet
+ * Returns the cached archive, or NULL with a description of the problem in
+ * 'error' if it could not be opened or scanned
+ */
+static cached_archive_t *get_archive(server_t *server, const char *path, const char **error) {
+    cached_archive_t *slot = &server->archives[0];
+    for (int i = 0; i < MAX_CACHED_ARCHIVES; i++) {
+        cached_archive_t *archive = &server->archives[i];
+        if (archive->fd != -1 && strcmp(archive->path, path) == 0) {
+            archive->last_used = server->requests;
+            return archive;
+        }
+        // Prefer an unused slot, then the least recently used one
+        if (slot->fd != -1 && (archive->fd == -1 || archive->last_used < slot->last_used)) {
+            slot = archive;
+        }
+    }
+
+    // The slot is only given up once its replacement is ready, so a request
+    // for a missing or damaged archive doesn't cost a useful cached index
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        *error = strerror(errno);
+        return NULL;
+    }
+    // Watch before scanning, so a change made during the scan still
+    // invalidates the index
+    int watch = inotify_add_watch(server->inotify_fd, path, ARCHIVE_EVENTS);
+    if (watch == -1) {
+        perror("Failed to watch archive");
+        *error = "Failed to watch archive";
+        close(fd);
+        return NULL;
+    }
+    archive_index_t index;
+    archive_index_init(&index);
+    if (archive_index_build(&index, fd) != 0) {
+        *error = "Failed to read archive";
+        release_watch(server, watch, NULL);
+        close(fd);
+        return NULL;
+    }
+
+    // The evicted archive may share the new one's watch, which must survive
+    if (slot->fd != -1 && slot->watch == watch) {
+        slot->watch = -1;
+    }
+    evict_archive(server, slot);
+    slot->index = index;
+    strcpy(slot->path, path);
+    slot->fd = fd;
+    slot->watch = watch;
+    slot->last_used = server->requests;
+    return slot;
+}
+
+/*
+ * Drops the index of every archive inotify reports as changed
+ * Returns 0 on success or -1 if an error occurs
+ */
+static int handle_archive_changes(server_t *server) {
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (1) {
+        ssize_t len = read(server->inotify_fd, buffer, sizeof(buffer));
+        if (len == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                return 0;
+            }
+            perror("Failed to read inotify events");
+            return -1;
+        }
+
+        for (char *p = buffer; p < buffer + len;) {
+            const struct inotify_event *event = (const struct inotify_event *) p;
+            for (int i = 0; i < MAX_CACHED_ARCHIVES; i++) {
+                cached_archive_t *archive = &server->archives[i];
+                if (archive->fd != -1 && archive->watch == event->wd) {
+                    evict_archive(server, archive);
+                }
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+static void send_error(int client_fd, const char *message) {
+    char status[MAX_STATUS_LEN];
+    int len = snprintf(status, sizeof(status), "ERR %s\n", message);
+    write_all(client_fd, status, len);
+}
+
+static int send_ok(int client_fd, size_t body_len) {
+    char status[MAX_STATUS_LEN];
+    int len = snprintf(status, sizeof(status), "OK %zu\n", body_len);
+    return write_all(client_fd, status, len);
+}
+
+// Sends the name of every member of 'archive', one per line
+static void send_list(int client_fd, const cached_archive_t *archive) {
+    const archive_index_t *index = &archive->index;
+    size_t body_len = 0;
+    for (int i = 0; i < index->count; i++) {
+        body_len += strnlen(index->entries[i].header.name, NAME_LEN) + 1;
+    }
+    if (send_ok(client_fd, body_len) != 0) {
+        return;
+    }
+
+    char buffer[IO_BUF_SIZE];
+    size_t len = 0;
+    for (int i = 0; i < index->count; i++) {
+        const char *name = index->entries[i].header.name;
+        size_t name_len = strnlen(name, NAME_LEN);
+        if (len + name_len + 1 > sizeof(buffer)) {
+            if (write_all(client_fd, buffer, len) != 0) {
+                return;
+            }
+            len = 0;
+        }
+        memcpy(buffer + len, name, name_len);
+        buffer[len + name_len] = '\n';
+        len += name_len + 1;
+    }
+    write_all(client_fd, buffer, len);
+}
+
+// Sends the metadata recorded for 'entry', one field per line
+static void send_stat(int client_fd, const archive_entry_t *entry) {
+    const tar_header *header = &entry->header;
+    unsigned long long mode = 0;
+    unsigned long long mtime = 0;
+    parse_octal_field(header->mode, sizeof(header->mode), &mode);
+    parse_octal_field(header->mtime, sizeof(header->mtime), &mtime);
+
+    char body[MAX_STATUS_LEN + NAME_LEN];
+    int len = snprintf(body, sizeof(body),
+                       "name: %.*s\nsize: %zu\nmode: %04llo\nmtime: %llu\nowner: %.32s\n"
+                       "group: %.32s\n",
+                       (int) NAME_LEN, header->name, entry->size, mode, mtime, header->uname,
+                       header->gname);
+    if (send_ok(client_fd, len) == 0) {
+        write_all(client_fd, body, len);
+    }
+}
+
+/*
+ * Reads one request from 'client_fd' and answers it
+ */
+static void handle_client(server_t *server, int client_fd) {
+    // A stalled client can't hold up the requests queued behind it for long
+    struct timeval timeout = {.tv_sec = CLIENT_TIMEOUT, .tv_usec = 0};
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    char request[MAX_REQUEST_LEN];
+    size_t len = 0;
+    while (len < sizeof(request)) {
+        ssize_t bytes_read = read(client_fd, request + len, sizeof(request) - len);
+        if (bytes_read == -1 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_read <= 0) {
+            break;
+        }
+        len += bytes_read;
+    }
+
+    // The archive path and member name must each end with a null byte
+    const char *path = request + 1;
+    const char *path_end = len > 1 ? memchr(path, '\0', len - 1) : NULL;
+    if (path_end == NULL || memchr(path_end + 1, '\0', request + len - path_end - 1) == NULL) {
+        send_error(client_fd, "Malformed request");
+        return;
+    }
+    const char *member = path_end + 1;
+    archive_request_t op = request[0];
+    if (op != REQUEST_LIST && op != REQUEST_STAT && op != REQUEST_READ) {
+        send_error(client_fd, "Unknown request");
+        return;
+    }
+
+    server->requests++;
+    const char *error;
+    cached_archive_t *archive = get_archive(server, path, &error);
+    if (archive == NULL) {
+        send_error(client_fd, error);
+        return;
+    }
+    if (op == REQUEST_LIST) {
+        send_list(client_fd, archive);
+        return;
+    }
+
+    const archive_entry_t *entry = archive_index_find(&archive->index, member);
+    if (entry == NULL) {
+        send_error(client_fd, "Not found in archive");
+    } else if (op == REQUEST_STAT) {
+        send_stat(client_fd, entry);
+    } else if (send_ok(client_fd, entry->size) == 0) {
+        copy_archive_range(archive->fd, entry->data_offset, entry->size, client_fd);
+    }
+}
+
+/*
+ * Creates a listening socket bound to 'socket_path'. A socket file left
+ * behind by a server that is no longer running is replaced
+ * Returns the socket's file descriptor, or -1 if an error occurs
+ */
+static int listen_on(const char *socket_path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path is too long\n");
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("Failed to create socket");
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+        fprintf(stderr, "A server is already listening on %s\n", socket_path);
+        close(fd);
+        return -1;
+    }
+    if (errno == ECONNREFUSED) {
+        unlink(socket_path);
+    }
+    close(fd);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("Failed to create socket");
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(fd, LISTEN_BACKLOG) != 0) {
+        perror("Failed to listen on socket");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int run_archive_server(const char *socket_path) {
+    struct sigaction action = {.sa_handler = request_stop};
+    sigemptyset(&action.sa_mask);
+    // No SA_RESTART, so a signal interrupts poll() and the loop can exit
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    // A client hanging up mid-response must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    server_t *server = malloc(sizeof(server_t));
+    if (server == NULL) {
+        perror("Failed to allocate server");
+        return -1;
+    }
+    for (int i = 0; i < MAX_CACHED_ARCHIVES; i++) {
+        server->archives[i].fd = -1;
+        archive_index_init(&server->archives[i].index);
+    }
+    server->requests = 0;
+    server->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (server->inotify_fd == -1) {
+        perror("Failed to initialize inotify");
+        free(server);
+        return -1;
+    }
+    int listen_fd = listen_on(socket_path);
+    if (listen_fd == -1) {
+        close(server->inotify_fd);
+        free(server);
+        return -1;
+    }
+
+    int result = 0;
+    while (!stop_requested) {
+        struct pollfd fds[2] = {{.fd = server->inotify_fd, .events = POLLIN},
+                                {.fd = listen_fd, .events = POLLIN}};
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Failed to wait for requests");
+            result = -1;
+            break;
+        }
+        // Changes are applied before any request queued behind them is served
+        if ((fds[0].revents & POLLIN) && handle_archive_changes(server) != 0) {
+            result = -1;
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            int client_fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+            if (client_fd == -1) {
+                if (errno != EINTR && errno != ECONNABORTED) {
+                    perror("Failed to accept connection");
+                }
+                continue;
+            }
+            handle_client(server, client_fd);
+            close(client_fd);
+        }
+    }
+
+    for (int i = 0; i < MAX_CACHED_ARCHIVES; i++) {
+        evict_archive(server, &server->archives[i]);
+    }
+    close(listen_fd);
+    unlink(socket_path);
+    close(server->inotify_fd);
+    free(server);
+    return result;
+}
+
+int archive_server_request(const char *socket_path, archive_request_t request,
+                           const char *archive_name, const char *member_name, int out_fd) {
+    // The server may run in another directory, so it gets an absolute path
+    char path[PATH_MAX];
+    if (realpath(archive_name, path) == NULL) {
+        perror("Failed to find archive");
+        return -1;
+    }
+    if (member_name == NULL) {
+        member_name = "";
+    }
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path is too long\n");
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("Failed to create socket");
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        perror("Failed to connect to server");
+        close(fd);
+        return -1;
+    }
+
+    char message[MAX_REQUEST_LEN];
+    size_t path_len = strlen(path) + 1;
+    size_t member_len = strlen(member_name) + 1;
+    if (member_len > NAME_LEN + 1) {
+        fprintf(stderr, "%s: Name is too long for an archive member\n", member_name);
+        close(fd);
+        return -1;
+    }
+    message[0] = request;
+    memcpy(message + 1, path, path_len);
+    memcpy(message + 1 + path_len, member_name, member_len);
+    if (write_all(fd, message, 1 + path_len + member_len) != 0 || shutdown(fd, SHUT_WR) != 0) {
+        perror("Failed to send request");
+        close(fd);
+        return -1;
+    }
+
+    // The status line is short, so reading it a byte at a time is cheap and
+    // leaves the body for the copy loop below
+    char status[MAX_STATUS_LEN];
+    size_t status_len = 0;
+    while (status_len < sizeof(status) - 1) {
+        ssize_t bytes_read = read(fd, status + status_len, 1);
+        if (bytes_read == -1 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_read <= 0 || status[status_len] == '\n') {
+            break;
+        }
+        status_len++;
+    }
+    status[status_len] = '\0';
+
+    unsigned long long body_len;
+    if (strncmp(status, "ERR ", 4) == 0) {
+        if (member_name[0] != '\0') {
+            fprintf(stderr, "%s: %s\n", member_name, status + 4);
+        } else {
+            fprintf(stderr, "%s\n", status + 4);
+        }
+        close(fd);
+        return -1;
+    }
+    if (sscanf(status, "OK %llu", &body_len) != 1) {
+        fprintf(stderr, "Malformed response from server\n");
+        close(fd);
+        return -1;
+    }
+
+    char buffer[IO_BUF_SIZE];
+    while (body_len > 0) {
+        size_t bytes_to_read = body_len < sizeof(buffer) ? body_len : sizeof(buffer);
+        ssize_t bytes_read = read(fd, buffer, bytes_to_read);
+        if (bytes_read == -1 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_read <= 0) {
+            fprintf(stderr, "Server closed the connection early\n");
+            close(fd);
+            return -1;
+        }
+        if (write_all(out_fd, buffer, bytes_read) != 0) {
+            perror("Failed to write response");
+            close(fd);
+            return -1;
+        }
+        body_len -= bytes_read;
+    }
+    close(fd);
+    return 0;
+}
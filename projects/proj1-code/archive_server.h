@@ -0,0 +1,35 @@
+#ifndef _ARCHIVE_SERVER_H
+#define _ARCHIVE_SERVER_H
+
+// Requests a client can send to the archive server
+typedef enum {
+    // Names of every member of an archive, one per line, in archive order
+    REQUEST_LIST = 'L',
+    // Metadata of the newest version of one member
+    REQUEST_STAT = 'S',
+    // Contents of the newest version of one member
+    REQUEST_READ = 'R'
+} archive_request_t;
+
+/*
+ * Serve requests for archives on a Unix domain socket bound to 'socket_path'
+ * until SIGINT or SIGTERM arrives.
+ * The member index of each archive requested is built on first use and kept
+ * in memory. inotify drops an index as soon as its archive is changed, moved
+ * or deleted, so the next request rescans it. Member contents are sent
+ * straight from the archive to the client with sendfile().
+ * This function should return 0 upon success or -1 if an error occurred.
+ */
+int run_archive_server(const char *socket_path);
+
+/*
+ * Ask the server listening on 'socket_path' to carry out 'request' for the
+ * archive identified by 'archive_name', writing the response to 'out_fd'.
+ * 'member_name' names the member for stat and read requests and is ignored
+ * for list requests. Errors reported by the server are printed to stderr.
+ * This function should return 0 upon success or -1 if an error occurred.
+ */
+int archive_server_request(const char *socket_path, archive_request_t request,
+                           const char *archive_name, const char *member_name, int out_fd);
+
+#endif    // _ARCHIVE_SERVER_H
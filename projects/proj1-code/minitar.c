@@ -1,27 +1,28 @@
 #include "minitar.h"
 
+#include <errno.h>
 #include <fcntl.h>
 #include <grp.h>
-#include <math.h>
 #include <pwd.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/sysmacros.h>
 #include <sys/types.h>
 #include <unistd.h>
 
-#define NUM_TRAILING_BLOCKS 2
-#define MAX_MSG_LEN 128
-#define BLOCK_SIZE 512
-
-// Constants for tar compatibility information
-#define MAGIC "ustar"
+#include "archive_extract.h"
+#include "archive_io.h"
+#include "minitar_stats.h"
 
-// Constants to represent different file types
-// We'll only use regular files in this project
-#define REGTYPE '0'
-#define DIRTYPE '5'
+#define MAX_MSG_LEN 128
+#define COPY_BUF_SIZE (64 * 1024)
+// Largest single transfer while a rate limit is in effect
+#define THROTTLE_CHUNK (1024 * 1024)
+// Largest size the 11 octal digits of a ustar size field can hold, 8 GiB - 1
+#define MAX_USTAR_SIZE 077777777777LL
 
 /*
  * Helper function to compute the checksum of a tar header block
@@ -40,27 +41,23 @@ void compute_checksum(tar_header *header) {
 }
 
 /*
- * Populates a tar header block pointed to by 'header' with metadata about
- * the file identified by 'file_name'.
+ * Populates a tar header block pointed to by 'header' with the metadata in
+ * 'stat_buf', recording the member under the name 'file_name'.
  * Returns 0 on success or -1 if an error occurs
  */
-int fill_tar_header(tar_header *header, const char *file_name) {
+int fill_tar_header_from_stat(tar_header *header, const char *file_name,
+                              const struct stat *stat_buf) {
     memset(header, 0, sizeof(tar_header));
     char err_msg[MAX_MSG_LEN];
-    struct stat stat_buf;
-    // stat is a system call to inspect file metadata
-    if (stat(file_name, &stat_buf) != 0) {
-        snprintf(err_msg, MAX_MSG_LEN, "Failed to stat file %s", file_name);
-        perror(err_msg);
-        return -1;
-    }
 
     strncpy(header->name, file_name, 100);    // Name of the file, null-terminated string
     snprintf(header->mode, 8, "%07o",
-             stat_buf.st_mode & 07777);    // Permissions for file, 0-padded octal
+             stat_buf->st_mode & 07777);    // Permissions for file, 0-padded octal
 
-    snprintf(header->uid, 8, "%07o", stat_buf.st_uid);    // Owner ID of the file, 0-padded octal
-    struct passwd *pwd = getpwuid(stat_buf.st_uid);       // Look up name corresponding to owner ID
+    snprintf(header->uid, 8, "%07o", stat_buf->st_uid);    // Owner ID of the file, 0-padded octal
+    double start = stats_begin();
+    struct passwd *pwd = getpwuid(stat_buf->st_uid);    // Look up name corresponding to owner ID
+    stats_end(PHASE_NSS_LOOKUP, start);
     if (pwd == NULL) {
         snprintf(err_msg, MAX_MSG_LEN, "Failed to look up owner name of file %s", file_name);
         perror(err_msg);
@@ -68,8 +65,10 @@ int fill_tar_header(tar_header *header, const char *file_name) {
     }
     strncpy(header->uname, pwd->pw_name, 32);    // Owner name of the file, null-terminated string
 
-    snprintf(header->gid, 8, "%07o", stat_buf.st_gid);    // Group ID of the file, 0-padded octal
-    struct group *grp = getgrgid(stat_buf.st_gid);        // Look up name corresponding to group ID
+    snprintf(header->gid, 8, "%07o", stat_buf->st_gid);    // Group ID of the file, 0-padded octal
+    start = stats_begin();
+    struct group *grp = getgrgid(stat_buf->st_gid);    // Look up name corresponding to group ID
+    stats_end(PHASE_NSS_LOOKUP, start);
     if (grp == NULL) {
         snprintf(err_msg, MAX_MSG_LEN, "Failed to look up group name of file %s", file_name);
         perror(err_msg);
@@ -77,244 +76,358 @@ int fill_tar_header(tar_header *header, const char *file_name) {
     }
     strncpy(header->gname, grp->gr_name, 32);    // Group name of the file, null-terminated string
 
-    snprintf(header->size, 12, "%011o",
-             (unsigned) stat_buf.st_size);    // File size, 0-padded octal
+    if (stat_buf->st_size > MAX_USTAR_SIZE) {
+        fprintf(stderr, "%s: file too large for ustar\n", file_name);
+        errno = EFBIG;
+        return -1;
+    }
+    snprintf(header->size, 12, "%011llo",
+             (unsigned long long) stat_buf->st_size);    // File size, 0-padded octal
     snprintf(header->mtime, 12, "%011o",
-             (unsigned) stat_buf.st_mtime);    // Modification time, 0-padded octal
+             (unsigned) stat_buf->st_mtime);    // Modification time, 0-padded octal
     header->typeflag = REGTYPE;                // File type, always regular file in this project
     strncpy(header->magic, MAGIC, 6);          // Special, standardized sequence of bytes
     memcpy(header->version, "00", 2);          // A bit weird, sidesteps null termination
     snprintf(header->devmajor, 8, "%07o",
-             major(stat_buf.st_dev));    // Major device number, 0-padded octal
+             major(stat_buf->st_dev));    // Major device number, 0-padded octal
     snprintf(header->devminor, 8, "%07o",
-             minor(stat_buf.st_dev));    // Minor device number, 0-padded octal
+             minor(stat_buf->st_dev));    // Minor device number, 0-padded octal
 
     compute_checksum(header);
     return 0;
 }
 
 /*
- * Removes 'nbytes' bytes from the file identified by 'file_name'
- * Returns 0 upon success, -1 upon error
- * Note: This function uses lower-level I/O syscalls (not stdio), which we'll learn about later
+ * Populates a tar header block pointed to by 'header' with metadata about
+ * the file identified by 'file_name'.
+ * Returns 0 on success or -1 if an error occurs
  */
-int remove_trailing_bytes(const char *file_name, size_t nbytes) {
+int fill_tar_header(tar_header *header, const char *file_name) {
     char err_msg[MAX_MSG_LEN];
-
     struct stat stat_buf;
+    // stat is a system call to inspect file metadata
+    double start = stats_begin();
     if (stat(file_name, &stat_buf) != 0) {
         snprintf(err_msg, MAX_MSG_LEN, "Failed to stat file %s", file_name);
         perror(err_msg);
         return -1;
     }
+    stats_end(PHASE_STAT, start);
+    return fill_tar_header_from_stat(header, file_name, &stat_buf);
+}
 
-    off_t file_size = stat_buf.st_size;
-    if (nbytes > file_size) {
-        file_size = 0;
-    } else {
-        file_size -= nbytes;
+/*
+ * Parses the 0-padded octal header field of 'len' bytes at 'field' into 'value'
+ * Returns 0 on success or -1 if the field is malformed
+ */
+int parse_octal_field(const char *field, size_t len, unsigned long long *value) {
+    char copy[32];
+    if (len >= sizeof(copy)) {
+        return -1;
     }
+    memcpy(copy, field, len);
+    copy[len] = '\0';
 
-    if (truncate(file_name, file_size) != 0) {
-        snprintf(err_msg, MAX_MSG_LEN, "Failed to truncate file %s", file_name);
-        perror(err_msg);
+    char *end;
+    errno = 0;
+    *value = strtoull(copy, &end, 8);
+    if (end == copy || errno != 0) {
         return -1;
     }
     return 0;
 }
 
-int create_archive(const char *archive_name, const file_list_t *files) {
-    FILE* file_path = fopen(archive_name,"wb");
-    // error check if file can be opened
-    if(file_path == NULL){
-        perror("failed to open file");
+/*
+ * Parses the 0-padded octal size field of 'header' into 'size'
+ * Returns 0 on success or -1 if the field is malformed
+ */
+int get_header_size(const tar_header *header, size_t *size) {
+    unsigned long long value;
+    if (parse_octal_field(header->size, sizeof(header->size), &value) != 0) {
         return -1;
     }
-    // get first file
-    node_t *current = files->head;
+    *size = value;
+    return 0;
+}
 
-    // while loop to iterate through every file in the list
-    while(current != NULL){
-        tar_header header;
-        // creates a tar header to the current file n and also write a tar header to archive path
-        if(fill_tar_header(&header,current->name) != 0){
-            perror("cannot write TAR header");
-            fclose(file_path);
-            return -1;
+/*
+ * Checks whether the 512-byte block pointed to by 'block' is all zeros,
+ * which is how the end of an archive is marked
+ * Returns 1 if every byte is zero, 0 otherwise
+ */
+int is_zero_block(const void *block) {
+    const char *bytes = block;
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+        if (bytes[i] != 0) {
+            return 0;
         }
+    }
+    return 1;
+}
 
-        if(fwrite(&header,sizeof(tar_header),1,file_path) != 1){
-            perror("cannot write TAR header");
-            fclose(file_path);
-            return -1;
-        }
+/*
+ * Reads the header of the archive member starting at offset '*pos' of the
+ * archive open as 'fd' into 'entry', then advances '*pos' to the next member
+ * Returns 1 if a member was read, 0 at the end of the archive, or -1 on error
+ */
+int read_archive_entry(int fd, off_t *pos, archive_entry_t *entry) {
+    double start = stats_begin();
+    ssize_t bytes_read = pread(fd, &entry->header, sizeof(tar_header), *pos);
+    if (bytes_read == -1) {
+        perror("Failed to read archive header");
+        return -1;
+    }
+    stats_end(PHASE_HEADER_SCAN, start);
+    stats_count_read(bytes_read);
+    // An archive missing its termination blocks simply ends after its last member
+    if (bytes_read == 0) {
+        return 0;
+    }
+    if (bytes_read != sizeof(tar_header)) {
+        fprintf(stderr, "Archive ends in the middle of a header\n");
+        return -1;
+    }
+    if (is_zero_block(&entry->header)) {
+        return 0;
+    }
+    if (get_header_size(&entry->header, &entry->size) != 0) {
+        fprintf(stderr, "Malformed size field in archive header\n");
+        return -1;
+    }
+    stats_count_header();
 
-        FILE *curr_file = fopen(current->name,"rb");
+    entry->header_offset = *pos;
+    entry->data_offset = *pos + BLOCK_SIZE;
+    *pos = entry->data_offset + (entry->size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+    return 1;
+}
 
-        if(curr_file == NULL){
-            fclose(file_path);
-            perror("current file does not exist");
+/*
+ * Writes all 'len' bytes at 'buf' to 'fd', retrying after short writes
+ * Returns 0 on success or -1 if an error occurs
+ */
+static int write_all(int fd, const void *buf, size_t len) {
+    const char *bytes = buf;
+    while (len > 0) {
+        ssize_t bytes_written = write(fd, bytes, len);
+        if (bytes_written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
             return -1;
         }
+        bytes += bytes_written;
+        len -= bytes_written;
+    }
+    return 0;
+}
 
-        unsigned file_size;
-        char buffer[BLOCK_SIZE];
-
-        if(sscanf(header.size,"%o",&file_size) != 1 ){
-            fclose(curr_file);
-            fclose(file_path);
-            perror("cannot parse file from TAR header");
-            return -1;
+/*
+ * Copies 'len' bytes starting at 'offset' in the archive open as 'archive_fd'
+ * to 'out_fd'. The bytes move inside the kernel with sendfile(); a
+ * pread()/write() loop is used only for outputs sendfile() can't handle.
+ * Under a rate limit the copy is split into chunks that are throttled in turn
+ * Returns 0 on success or -1 if an error occurs
+ */
+int copy_archive_range(int archive_fd, off_t offset, size_t len, int out_fd) {
+    int use_sendfile = 1;
+    size_t max_chunk = get_io_options()->rate_limit != 0 ? THROTTLE_CHUNK : len;
+    char buffer[COPY_BUF_SIZE];
+    stats_count_read(len);
+    stats_count_write(len);
+    while (len > 0) {
+        ssize_t bytes_copied;
+        size_t chunk = len < max_chunk ? len : max_chunk;
+        double start = stats_begin();
+        if (use_sendfile) {
+            // Reads and writes in one step, so it all counts as output
+            bytes_copied = sendfile(out_fd, archive_fd, &offset, chunk);
+            stats_end(PHASE_OUTPUT_WRITE, start);
+            if (bytes_copied == -1 && (errno == EINVAL || errno == ENOSYS)) {
+                // e.g. an O_APPEND output file or a terminal
+                use_sendfile = 0;
+                continue;
+            }
+        } else {
+            size_t bytes_to_read = chunk < COPY_BUF_SIZE ? chunk : COPY_BUF_SIZE;
+            bytes_copied = pread(archive_fd, buffer, bytes_to_read, offset);
+            stats_end(PHASE_ARCHIVE_READ, start);
+            if (bytes_copied > 0) {
+                start = stats_begin();
+                if (write_all(out_fd, buffer, bytes_copied) != 0) {
+                    perror("Failed to write member data");
+                    return -1;
+                }
+                stats_end(PHASE_OUTPUT_WRITE, start);
+                offset += bytes_copied;
+            }
         }
 
-        unsigned bytes_remain =  file_size;
-
-        while(bytes_remain > 0){
-            memset(buffer,0,BLOCK_SIZE);
-
-            size_t bytes_need_reading = fmin(bytes_remain,BLOCK_SIZE);
-            size_t bytes_read = fread(buffer,1,bytes_need_reading,curr_file);
-            // error check to see that there is a correct number of expected bytes
-
-            if(bytes_read != bytes_need_reading){
-                fclose(file_path);
-                fclose(curr_file);
-                perror("does not meee the number of expected bytes for bytes read and bytes need to read");
-                return -1;
+        if (bytes_copied == -1) {
+            if (errno == EINTR) {
+                continue;
             }
+            perror("Failed to copy member data");
+            return -1;
+        }
+        if (bytes_copied == 0) {
+            fprintf(stderr, "Archive ends in the middle of a member\n");
+            return -1;
+        }
+        io_throttle(bytes_copied);
+        len -= bytes_copied;
+    }
+    return 0;
+}
 
-            if(fwrite(buffer,BLOCK_SIZE,1,file_path) != 1 ){
-                fclose(file_path);
-                fclose(curr_file);
-                perror("cannot write data blocks");
-                return -1;
-            }
+/*
+ * Removes 'nbytes' bytes from the file identified by 'file_name'
+ * Returns 0 upon success, -1 upon error
+ * Note: This function uses lower-level I/O syscalls (not stdio), which we'll learn about later
+ */
+int remove_trailing_bytes(const char *file_name, size_t nbytes) {
+    char err_msg[MAX_MSG_LEN];
 
-            bytes_remain = bytes_remain - bytes_read;
-        }
+    struct stat stat_buf;
+    if (stat(file_name, &stat_buf) != 0) {
+        snprintf(err_msg, MAX_MSG_LEN, "Failed to stat file %s", file_name);
+        perror(err_msg);
+        return -1;
+    }
 
-        fclose(curr_file);
-        current = current->next;
+    off_t file_size = stat_buf.st_size;
+    if (nbytes > file_size) {
+        file_size = 0;
+    } else {
+        file_size -= nbytes;
     }
 
-    char zero_block[BLOCK_SIZE];
-    memset(zero_block,0,BLOCK_SIZE);
-    // put in correct format with 2 blocks at the end and close the file path
-    if (fwrite(zero_block, BLOCK_SIZE, 1, file_path) != 1 ||
-        fwrite(zero_block, BLOCK_SIZE, 1, file_path) != 1) {
-        perror("cannot write zeros blocks");
-        fclose(file_path);
+    if (truncate(file_name, file_size) != 0) {
+        snprintf(err_msg, MAX_MSG_LEN, "Failed to truncate file %s", file_name);
+        perror(err_msg);
         return -1;
     }
-
-    fclose(file_path);
     return 0;
 }
 
-
-int append_files_to_archive(const char *archive_name, const file_list_t *files) {
-    FILE *archive_file_path = fopen(archive_name,"rb");
-    // check if file can be opened
-    if(archive_file_path == NULL){
-        perror("archive file path cannot be opened");
+/*
+ * Writes the header and data blocks of the file identified by 'file_name'
+ * to the end of the archive being written by 'writer'
+ * Returns 0 on success or -1 if an error occurs
+ */
+static int write_member(archive_writer_t *writer, const char *file_name) {
+    double member_start = stats_begin();
+    tar_header header;
+    // creates a tar header to the current file n and also write a tar header to archive path
+    if (fill_tar_header(&header, file_name) != 0) {
+        perror("cannot write TAR header");
         return -1;
     }
 
-    fclose(archive_file_path);
+    if (archive_writer_write(writer, &header, sizeof(tar_header)) != 0) {
+        perror("cannot write TAR header");
+        return -1;
+    }
 
-    // remove the trailing blocks from archive, checks to see if this does not return an error
-    if(remove_trailing_bytes(archive_name,NUM_TRAILING_BLOCKS * BLOCK_SIZE) != 0){
-        perror("cannot remove termination blocks from archive");
+    int curr_fd = open(file_name, O_RDONLY);
+    if (curr_fd == -1) {
+        perror("current file does not exist");
         return -1;
     }
 
-    archive_file_path = fopen(archive_name,"ab");
-    // check to see if file path can be appended
-    if(archive_file_path == NULL){
-        perror("cannot append archive");
+    size_t file_size;
+    if (get_header_size(&header, &file_size) != 0) {
+        close(curr_fd);
+        perror("cannot parse file from TAR header");
         return -1;
     }
 
-    // get current file
-    node_t *curr = files -> head;
+    if (archive_writer_copy_fd(writer, curr_fd, file_size) != 0) {
+        close(curr_fd);
+        perror("cannot write data blocks");
+        return -1;
+    }
+    close(curr_fd);
 
-    // iterate throuhg all the files in the list
-    while(curr != NULL){
-        tar_header header;
+    // data is padded with zeros out to a whole number of blocks
+    char zero_block[BLOCK_SIZE];
+    memset(zero_block, 0, BLOCK_SIZE);
+    size_t padding = (BLOCK_SIZE - file_size % BLOCK_SIZE) % BLOCK_SIZE;
+    if (archive_writer_write(writer, zero_block, padding) != 0) {
+        perror("cannot write data blocks");
+        return -1;
+    }
 
-        // create and write the TAR header to the current file and write tar header to archive
-        if(fill_tar_header(&header,curr->name) != 0){
-            fclose(archive_file_path);
-            perror("cannot make TAR header");
-            return -1;
-        }
+    stats_member_done(member_start);
+    return 0;
+}
 
-        if(fwrite(&header,sizeof(tar_header),1,archive_file_path) != 1){
-            fclose(archive_file_path);
-            perror("cannot make TAR header to archive");
+/*
+ * Writes the blocks of zeros that mark the end of an archive through 'writer'
+ * Returns 0 on success or -1 if an error occurs
+ */
+static int write_trailer(archive_writer_t *writer) {
+    char zero_block[BLOCK_SIZE];
+    memset(zero_block, 0, BLOCK_SIZE);
+    // put in correct format with 2 blocks at the end
+    for (int i = 0; i < NUM_TRAILING_BLOCKS; i++) {
+        if (archive_writer_write(writer, zero_block, BLOCK_SIZE) != 0) {
+            perror("cannot write zeros blocks");
             return -1;
         }
+    }
+    return 0;
+}
 
-        FILE *curr_file_path = fopen(curr->name,"rb");
-        // check if file path can be opened
-        if(curr_file_path == NULL){
-            fclose(archive_file_path);
-            perror("cannot open current file");
-            return -1;
-        }
+int create_archive(const char *archive_name, const file_list_t *files) {
+    archive_writer_t writer;
+    // error check if file can be opened
+    if (archive_writer_open(&writer, archive_name, 0) != 0) {
+        perror("failed to open file");
+        return -1;
+    }
 
-        unsigned file_size ;
-        // process file size from the TAR header
-        if(sscanf(header.size,"%o",&file_size) != 1){
-            fclose(curr_file_path);
-            fclose(archive_file_path);
-            perror("cannot process file size from the TAR header");
+    // while loop to iterate through every file in the list
+    for (node_t *current = files->head; current != NULL; current = current->next) {
+        if (write_member(&writer, current->name) != 0) {
+            archive_writer_discard(&writer);
             return -1;
         }
+    }
 
-        char buffer[BLOCK_SIZE];
-        unsigned bytes_remain = file_size;
-
-        // copy data by block_size , using buffer and checking if we use the expected amount of bytes
-        while(bytes_remain > 0){
-            memset(buffer,0,BLOCK_SIZE);
+    if (write_trailer(&writer) != 0) {
+        archive_writer_discard(&writer);
+        return -1;
+    }
 
-            size_t bytes_to_read = fmin(bytes_remain,BLOCK_SIZE);
-            size_t bytes_read = fread(buffer, 1, bytes_to_read, curr_file_path);
+    return archive_writer_close(&writer);
+}
 
-            if(bytes_read != bytes_to_read){
-                fclose(curr_file_path);
-                fclose(archive_file_path);
-                perror("did not get the expected number of bytes for bytes read and bytes to read");
-                return -1;
-            }
 
-            if(fwrite(buffer, BLOCK_SIZE, 1, archive_file_path) != 1){
-                fclose(curr_file_path);
-                fclose(archive_file_path);
-                perror("cannot write blocks to archive ");
-                return -1;
-            }
+int append_files_to_archive(const char *archive_name, const file_list_t *files) {
+    archive_writer_t writer;
+    // new members are written over the termination blocks, which stay in
+    // place until the append is complete
+    if (archive_writer_open(&writer, archive_name, 1) != 0) {
+        perror("archive file path cannot be opened");
+        return -1;
+    }
 
-            bytes_remain = bytes_remain - bytes_read;
+    // iterate throuhg all the files in the list
+    for (node_t *curr = files->head; curr != NULL; curr = curr->next) {
+        if (write_member(&writer, curr->name) != 0) {
+            archive_writer_discard(&writer);
+            return -1;
         }
-        // closes the current file and move up to the next file
-        fclose(curr_file_path);
-        curr = curr -> next;
     }
 
-    char zero_block[BLOCK_SIZE];
-    memset(zero_block, 0, BLOCK_SIZE);
     // add to zero blocks at the end of the archive
-    if (fwrite(zero_block, BLOCK_SIZE, 1, archive_file_path) != 1 ||
-        fwrite(zero_block, BLOCK_SIZE, 1, archive_file_path) != 1) {
-        fclose(archive_file_path);
-        perror("cannot write TAR termination blocks");
+    if (write_trailer(&writer) != 0) {
+        archive_writer_discard(&writer);
         return -1;
     }
 
-    fclose(archive_file_path);
-    return 0;
+    return archive_writer_close(&writer);
 }
 
 int get_archive_file_list(const char *archive_name, file_list_t *files) {
@@ -329,20 +442,14 @@ int get_archive_file_list(const char *archive_name, file_list_t *files) {
 
     // read each TAR header then check if the header is all zeros
     // if it is all zeros then break as we reach the end of the archive
+    double start = stats_begin();
     while(fread(&header,sizeof(tar_header),1,archive_file_path)== 1){
-        int zero = 1;
-        char *bytes = (char *)&header;
-
-        for(int i = 0; i < sizeof(tar_header);i++){
-            if(bytes[i] != 0){
-                zero = 0;
-                break;
-            }
-        }
-
-        if(zero){
+        stats_end(PHASE_HEADER_SCAN, start);
+        stats_count_read(sizeof(tar_header));
+        if(is_zero_block(&header)){
             break;
         }
+        stats_count_header();
 
         if(file_list_add(files,header.name) != 0){
             fclose(archive_file_path);
@@ -350,20 +457,21 @@ int get_archive_file_list(const char *archive_name, file_list_t *files) {
             return -1;
         }
 
-        unsigned file_size;
-        if (sscanf(header.size, "%o", &file_size) != 1) {
+        size_t file_size;
+        if (get_header_size(&header, &file_size) != 0) {
             fclose(archive_file_path);
             perror("cannot get file size from TAR header");
             return -1;
         }
         // rounds up as it is stored in chuncks of blockssize
-        unsigned block_needed = (file_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        off_t block_needed = (file_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
 
-         if (fseek(archive_file_path, block_needed * BLOCK_SIZE, SEEK_CUR) != 0) {
+         if (fseeko(archive_file_path, block_needed * BLOCK_SIZE, SEEK_CUR) != 0) {
             fclose(archive_file_path);
             perror("cannot get past blocks for this file");
             return -1;
         }
+        start = stats_begin();
     }
     fclose(archive_file_path);
     return 0;
@@ -371,84 +479,44 @@ int get_archive_file_list(const char *archive_name, file_list_t *files) {
 
 
 int extract_files_from_archive(const char *archive_name) {
+    return extract_archive(archive_name, ".");
+}
 
-    // check if we can open file
-    FILE *archive_file_path = fopen(archive_name,"rb");
-    if(archive_file_path == NULL){
-        perror("cannot open file");
+int extract_file_to_fd(const char *archive_name, const char *file_name, int out_fd) {
+    int archive_fd = open(archive_name, O_RDONLY);
+    if (archive_fd == -1) {
+        perror("cannot open archive file");
         return -1;
     }
 
-    // init list and prevent same files
-    file_list_t processed_files;
-    file_list_init(&processed_files);
-
-    tar_header header;
-
-    // read all TAR header from the archive
-    while(fread(&header,sizeof(tar_header),1,archive_file_path) == 1){
-        int zeros = 1;
-        char *bytes = (char *)&header;
-        // check if header is all zeros
-        for(int i = 0;i< sizeof(tar_header);i++){
-            if(bytes[i] != 0){
-                zeros = 0;
-                break;
-            }
-        }
-
-        // if all zeros we reach the end of archive and break the loop
-        if(zeros){
-            break;
-        }
-
-        unsigned file_size;
-        if(sscanf(header.size,"%o",&file_size) != 1){
-            file_list_clear(&processed_files);
-            fclose(archive_file_path);
-            perror("cannot process file from TAR header ");
-            return -1;
-        }
-        // open output file and check that we can open
-        FILE *output_file = fopen(header.name, "wb");
-        if (output_file == NULL) {
-            file_list_clear(&processed_files);
-            perror("cannot make output file");
-            return -1;
-        }
-
-        unsigned bytes_remain = file_size;
-        char buffer[BLOCK_SIZE];
-
-        // read data in block_size size
-        while(bytes_remain > 0){
-            if(fread(buffer,BLOCK_SIZE,1,archive_file_path) != 1){
-                fclose(output_file);
-                file_list_clear(&processed_files);
-                fclose(archive_file_path);
-                perror("cannot read data from block from archive");
-                return -1;
-            }
-
-            size_t bytes_to_write = fmin(bytes_remain,BLOCK_SIZE);
-            // writes data to the file
-            if(fwrite(buffer,1,bytes_to_write,output_file) != bytes_to_write){
-                fclose(output_file);
-                file_list_clear(&processed_files);
-                fclose(archive_file_path);
-                perror("cannot write data to file");
-                return -1;
-            }
-            bytes_remain = bytes_remain - bytes_to_write;
-        }
-        fclose(output_file);
-        // check if the file is a duplicate by check the file list for that file
-        if(!file_list_contains(&processed_files,header.name)){
-            file_list_add(&processed_files,header.name);
+    // Later versions of a file are appended after earlier ones, so the last
+    // matching header wins
+    archive_entry_t entry;
+    archive_entry_t newest;
+    int found = 0;
+    off_t pos = 0;
+    int result;
+    while ((result = read_archive_entry(archive_fd, &pos, &entry)) == 1) {
+        if (strncmp(entry.header.name, file_name, sizeof(entry.header.name)) == 0) {
+            newest = entry;
+            found = 1;
         }
     }
+    if (result == -1) {
+        close(archive_fd);
+        return -1;
+    }
+    if (!found) {
+        fprintf(stderr, "%s: Not found in archive\n", file_name);
+        close(archive_fd);
+        return -1;
+    }
 
-    file_list_clear(&processed_files);
-    fclose(archive_file_path);
-    return 0;
+    double member_start = stats_begin();
+    result = copy_archive_range(archive_fd, newest.data_offset, newest.size, out_fd);
+    if (result == 0) {
+        stats_member_done(member_start);
+    }
+    close(archive_fd);
+    return result;
 }
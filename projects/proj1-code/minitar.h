@@ -1,7 +1,22 @@
 #ifndef _MINITAR_H
 #define _MINITAR_H
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
 #include "file_list.h"
 
+#define NUM_TRAILING_BLOCKS 2
+#define BLOCK_SIZE 512
+
+// Constants for tar compatibility information
+#define MAGIC "ustar"
+
+// Constants to represent different file types
+// We'll only use regular files in this project
+#define REGTYPE '0'
+#define DIRTYPE '5'
+
 // Standard tar header layout defined by POSIX
 typedef struct {
     // File's name, as a null-terminated string
@@ -39,6 +54,33 @@ typedef struct {
     char padding[12];
 } tar_header;
 
+/*
+ * Helpers for building and parsing header blocks, shared with the other
+ * archive modules. See minitar.c for details.
+ */
+void compute_checksum(tar_header *header);
+int fill_tar_header(tar_header *header, const char *file_name);
+int fill_tar_header_from_stat(tar_header *header, const char *file_name,
+                              const struct stat *stat_buf);
+int parse_octal_field(const char *field, size_t len, unsigned long long *value);
+int get_header_size(const tar_header *header, size_t *size);
+int is_zero_block(const void *block);
+
+// Location of one member within an archive file
+typedef struct {
+    // Copy of the member's header block
+    tar_header header;
+    // Offset of the header block from the start of the archive
+    off_t header_offset;
+    // Offset of the member's body from the start of the archive
+    off_t data_offset;
+    // Size of the member's body in bytes
+    size_t size;
+} archive_entry_t;
+
+int read_archive_entry(int fd, off_t *pos, archive_entry_t *entry);
+int copy_archive_range(int archive_fd, off_t offset, size_t len, int out_fd);
+
 /*
  * Create a new archive file with the name 'archive_name'.
  * The archive should contain all files stored in the 'files' list.
@@ -77,4 +119,13 @@ int get_archive_file_list(const char *archive_name, file_list_t *files);
  */
 int extract_files_from_archive(const char *archive_name);
 
+/*
+ * Write the contents of the most recently added version of the file named
+ * 'file_name' in the archive identified by 'archive_name' to the file
+ * descriptor 'out_fd', without creating any new files.
+ * This function should return 0 upon success or -1 if an error occurred
+ * (including if no file of that name is present in the archive).
+ */
+int extract_file_to_fd(const char *archive_name, const char *file_name, int out_fd);
+
 #endif    // _MINITAR_H
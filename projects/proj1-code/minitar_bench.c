@@ -0,0 +1,707 @@
+// minitar_bench.c: generates synthetic sets of files and measures how quickly
+// minitar creates, appends to, lists, updates, and extracts archives of them,
+// with GNU tar run on the same inputs for comparison. Each measurement is
+// repeated with a warm and a cold page cache. Results are printed as a table
+// and written as JSON so that runs can be compared to catch regressions.
+#define _GNU_SOURCE    // copy_file_range()
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_RUNS 32
+#define MAX_RESULTS 256
+#define WRITE_CHUNK (1024 * 1024)
+#define TRAILER_SIZE 1024
+// Lets the child's argv hold the names of every file in the largest corpus
+#define CHILD_STACK_LIMIT (256L * 1024 * 1024)
+
+// One synthetic set of files to archive
+typedef struct {
+    const char *name;
+    // Number of files and size range at a scale of 1.0
+    int base_count;
+    long long min_size;
+    long long max_size;
+    // Number of times every file appears in the archive used for the
+    // list/extract/append/update measurements
+    int versions;
+    // Whether the file count (rather than file size) shrinks with the scale
+    int scale_count;
+
+    char dir[PATH_MAX];
+    char base_archive[PATH_MAX];
+    char **files;
+    int num_files;
+    long long total_bytes;
+    // Files passed to -a and -u: the first 'num_subset' entries of 'files'
+    int num_subset;
+    long long subset_bytes;
+} corpus_t;
+
+// All timings for one (corpus, tool, operation, cache state) combination
+typedef struct {
+    const char *corpus;
+    const char *tool;
+    const char *op;
+    const char *cache;
+    int num_files;
+    long long bytes;
+    double runs[MAX_RUNS];
+    int num_runs;
+    int failed;
+} result_t;
+
+typedef struct {
+    double scale;
+    int runs;
+    int use_tar;
+    int use_cold;
+    const char *output;
+    const char *only;
+    // Kept well below PATH_MAX so that paths built from it always fit
+    char work_dir[PATH_MAX / 2];
+    char minitar[PATH_MAX];
+} options_t;
+
+static corpus_t corpora[] = {
+    {"tiny", 100000, 0, 511, 1, 1},
+    {"large", 3, 2LL << 30, 2LL << 30, 1, 0},
+    {"mixed", 2000, 64, 16LL << 20, 1, 1},
+    {"versions", 50, 1024, 128 * 1024, 20, 1},
+};
+#define NUM_CORPORA (sizeof(corpora) / sizeof(corpora[0]))
+
+static result_t results[MAX_RESULTS];
+static int num_results = 0;
+static const char *cold_method = "none";
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+/*
+ * xorshift64* generator: fast, deterministic filler for corpus contents
+ */
+static uint64_t next_random(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ULL;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Writes a file named 'path' holding 'size' pseudo-random bytes
+ * Returns 0 on success or -1 if an error occurs
+ */
+static int write_random_file(const char *path, long long size, char *buffer) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror(path);
+        return -1;
+    }
+    while (size > 0) {
+        size_t chunk = size < WRITE_CHUNK ? size : WRITE_CHUNK;
+        for (size_t i = 0; i < chunk; i += sizeof(uint64_t)) {
+            uint64_t value = next_random();
+            memcpy(buffer + i, &value, sizeof(value));
+        }
+        if (write(fd, buffer, chunk) != chunk) {
+            perror(path);
+            close(fd);
+            return -1;
+        }
+        size -= chunk;
+    }
+    close(fd);
+    return 0;
+}
+
+/*
+ * Picks a file size for 'corpus'; sizes are spread evenly on a log scale so
+ * that every order of magnitude in the range is represented
+ */
+static long long pick_size(const corpus_t *corpus, double scale) {
+    long long min = corpus->min_size;
+    long long max = corpus->max_size;
+    if (!corpus->scale_count) {
+        min = (long long) (min * scale) > WRITE_CHUNK ? (long long) (min * scale) : WRITE_CHUNK;
+        max = min;
+    }
+    if (max <= min) {
+        return min;
+    }
+    if (min < 64) {
+        return min + next_random() % (max - min + 1);
+    }
+    double fraction = (next_random() >> 11) / (double) (1ULL << 53);
+    double log_size = (1 - fraction) * log(min) + fraction * log(max);
+    return (long long) exp(log_size);
+}
+
+static int remove_entry(const char *path, const struct stat *sb, int flag, struct FTW *ftw) {
+    return remove(path);
+}
+
+/*
+ * Deletes the directory tree rooted at 'path', if it exists
+ */
+static void remove_tree(const char *path) {
+    nftw(path, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+}
+
+/*
+ * Runs 'argv' to completion in 'dir' with stdout discarded
+ * Returns the elapsed wall time in seconds, or -1 if the command failed
+ */
+static double run_command(const char *dir, char **argv) {
+    double start = now_seconds();
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        struct rlimit limit = {CHILD_STACK_LIMIT, CHILD_STACK_LIMIT};
+        setrlimit(RLIMIT_STACK, &limit);
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd != -1) {
+            dup2(null_fd, STDOUT_FILENO);
+            close(null_fd);
+        }
+        if (chdir(dir) != 0) {
+            perror(dir);
+            _exit(127);
+        }
+        execvp(argv[0], argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) == -1) {
+        perror("waitpid");
+        return -1;
+    }
+    double elapsed = now_seconds() - start;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        return -1;
+    }
+    return elapsed;
+}
+
+/*
+ * Builds the argv for running 'tool' ("minitar" or "tar") with 'op' on
+ * 'archive' and the first 'num_files' names in 'files'. The caller frees it
+ */
+static char **build_argv(const options_t *opts, const char *tool, const char *op,
+                         const char *archive, char **files, int num_files) {
+    char **argv = malloc((num_files + 5) * sizeof(char *));
+    if (argv == NULL) {
+        return NULL;
+    }
+    int argc = 0;
+    int is_tar = strcmp(tool, "tar") == 0;
+    argv[argc++] = is_tar ? "tar" : (char *) opts->minitar;
+    if (strcmp(op, "create") == 0) {
+        argv[argc++] = "-c";
+    } else if (strcmp(op, "append") == 0) {
+        argv[argc++] = is_tar ? "-r" : "-a";
+    } else if (strcmp(op, "list") == 0) {
+        argv[argc++] = "-t";
+    } else if (strcmp(op, "update") == 0) {
+        argv[argc++] = "-u";
+    } else {
+        argv[argc++] = "-x";
+    }
+    argv[argc++] = "-f";
+    argv[argc++] = (char *) archive;
+    for (int i = 0; i < num_files; i++) {
+        argv[argc++] = files[i];
+    }
+    argv[argc] = NULL;
+    return argv;
+}
+
+/*
+ * Evicts the corpus files and 'archive' from the page cache. Dropping the
+ * whole cache needs root; otherwise each file's pages are dropped with
+ * posix_fadvise(POSIX_FADV_DONTNEED)
+ */
+static void drop_caches(const corpus_t *corpus, const char *archive) {
+    sync();
+    int fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+    if (fd != -1) {
+        int ok = write(fd, "3", 1) == 1;
+        close(fd);
+        if (ok) {
+            cold_method = "drop_caches";
+            return;
+        }
+    }
+
+    cold_method = "fadvise";
+    char path[PATH_MAX * 2];
+    for (int i = 0; i <= corpus->num_files; i++) {
+        if (i < corpus->num_files) {
+            snprintf(path, sizeof(path), "%s/%s", corpus->dir, corpus->files[i]);
+        } else {
+            snprintf(path, sizeof(path), "%s", archive);
+        }
+        fd = open(path, O_RDONLY);
+        if (fd != -1) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+    }
+}
+
+/*
+ * Copies the file 'src' to 'dest', inside the kernel where possible
+ * Returns 0 on success or -1 if an error occurs
+ */
+static int copy_whole_file(const char *src, const char *dest) {
+    int in_fd = open(src, O_RDONLY);
+    int out_fd = open(dest, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    struct stat stat_buf;
+    if (in_fd == -1 || out_fd == -1 || fstat(in_fd, &stat_buf) != 0) {
+        perror("Failed to copy archive");
+        close(in_fd);
+        close(out_fd);
+        return -1;
+    }
+    off_t remaining = stat_buf.st_size;
+    while (remaining > 0) {
+        ssize_t copied = copy_file_range(in_fd, NULL, out_fd, NULL, remaining, 0);
+        if (copied <= 0) {
+            perror("Failed to copy archive");
+            close(in_fd);
+            close(out_fd);
+            return -1;
+        }
+        remaining -= copied;
+    }
+    close(in_fd);
+    close(out_fd);
+    return 0;
+}
+
+/*
+ * Puts a copy of the base archive that was appended to back to its original
+ * state by cutting off whatever was added and restoring the trailer, which is
+ * much cheaper than copying the whole archive again
+ */
+static int restore_archive(const char *path, off_t original_size) {
+    static const char zeros[TRAILER_SIZE];
+    int fd = open(path, O_WRONLY);
+    if (fd == -1 || ftruncate(fd, original_size) != 0 ||
+        pwrite(fd, zeros, TRAILER_SIZE, original_size - TRAILER_SIZE) != TRAILER_SIZE) {
+        perror("Failed to restore archive");
+        if (fd != -1) {
+            close(fd);
+        }
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+/*
+ * Sets the modification time of each file passed to -u to now, so that GNU
+ * tar considers them newer than their archived versions just like minitar does
+ */
+static void touch_subset(const corpus_t *corpus) {
+    int dir_fd = open(corpus->dir, O_RDONLY | O_DIRECTORY);
+    for (int i = 0; i < corpus->num_subset; i++) {
+        utimensat(dir_fd, corpus->files[i], NULL, 0);
+    }
+    close(dir_fd);
+}
+
+/*
+ * Generates the files of 'corpus' under the work directory, reusing files
+ * left by an earlier run at the same scale
+ * Returns 0 on success or -1 if an error occurs
+ */
+static int generate_corpus(corpus_t *corpus, const options_t *opts) {
+    snprintf(corpus->dir, sizeof(corpus->dir), "%s/%s", opts->work_dir, corpus->name);
+    int count = corpus->scale_count ? (int) (corpus->base_count * opts->scale) : corpus->base_count;
+    if (count < 1) {
+        count = 1;
+    }
+
+    corpus->files = malloc(count * sizeof(char *));
+    if (corpus->files == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    corpus->num_files = count;
+    corpus->total_bytes = 0;
+    corpus->num_subset = count / 10 > 0 ? count / 10 : 1;
+    corpus->subset_bytes = 0;
+
+    char marker[PATH_MAX + 16];
+    char expected[64];
+    char found[64] = "";
+    snprintf(marker, sizeof(marker), "%s/.complete", corpus->dir);
+    snprintf(expected, sizeof(expected), "scale=%g", opts->scale);
+    FILE *marker_file = fopen(marker, "r");
+    if (marker_file != NULL) {
+        if (fgets(found, sizeof(found), marker_file) == NULL) {
+            found[0] = '\0';
+        }
+        fclose(marker_file);
+    }
+    int reuse = strcmp(found, expected) == 0;
+    if (!reuse) {
+        remove_tree(corpus->dir);
+        if (mkdir(corpus->dir, 0755) != 0) {
+            perror(corpus->dir);
+            return -1;
+        }
+        printf("Generating %d files for corpus '%s'...\n", count, corpus->name);
+        fflush(stdout);
+    }
+
+    char *buffer = malloc(WRITE_CHUNK);
+    if (buffer == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    char path[PATH_MAX * 2];
+    for (int i = 0; i < count; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "%c%06d", corpus->name[0], i);
+        corpus->files[i] = strdup(name);
+        snprintf(path, sizeof(path), "%s/%s", corpus->dir, name);
+
+        struct stat stat_buf;
+        if (reuse && stat(path, &stat_buf) == 0) {
+            corpus->total_bytes += stat_buf.st_size;
+        } else {
+            long long size = pick_size(corpus, opts->scale);
+            if (write_random_file(path, size, buffer) != 0) {
+                free(buffer);
+                return -1;
+            }
+            corpus->total_bytes += size;
+            stat(path, &stat_buf);
+        }
+        if (i < corpus->num_subset) {
+            corpus->subset_bytes += stat_buf.st_size;
+        }
+    }
+    free(buffer);
+
+    // The archive used to measure everything but -c, holding every file
+    // 'versions' times over
+    snprintf(corpus->base_archive, sizeof(corpus->base_archive), "%s/%s-base.tar",
+             opts->work_dir, corpus->name);
+    if (!reuse || access(corpus->base_archive, R_OK) != 0) {
+        for (int v = 0; v < corpus->versions; v++) {
+            char **argv = build_argv(opts, "minitar", v == 0 ? "create" : "append",
+                                     corpus->base_archive, corpus->files, corpus->num_files);
+            double elapsed = run_command(corpus->dir, argv);
+            free(argv);
+            if (elapsed < 0) {
+                fprintf(stderr, "Failed to build base archive for corpus '%s'\n", corpus->name);
+                return -1;
+            }
+        }
+    }
+
+    marker_file = fopen(marker, "w");
+    if (marker_file != NULL) {
+        fprintf(marker_file, "%s", expected);
+        fclose(marker_file);
+    }
+    return 0;
+}
+
+/*
+ * Measures 'tool' performing 'op' on 'corpus' with the given cache state,
+ * recording one result entry
+ */
+static void measure(const options_t *opts, corpus_t *corpus, const char *tool, const char *op,
+                    int cold) {
+    if (num_results == MAX_RESULTS) {
+        return;
+    }
+    result_t *result = &results[num_results++];
+    memset(result, 0, sizeof(*result));
+    result->corpus = corpus->name;
+    result->tool = tool;
+    result->op = op;
+    result->cache = cold ? "cold" : "warm";
+
+    char archive[PATH_MAX * 2];
+    char extract_dir[PATH_MAX * 2];
+    const char *run_dir = corpus->dir;
+    int num_args = 0;
+    off_t original_size = 0;
+    int is_create = strcmp(op, "create") == 0;
+    int modifies = strcmp(op, "append") == 0 || strcmp(op, "update") == 0;
+    int is_extract = strcmp(op, "extract") == 0;
+
+    if (is_create) {
+        snprintf(archive, sizeof(archive), "%s/%s-%s.tar", opts->work_dir, corpus->name, tool);
+        num_args = corpus->num_files;
+        result->num_files = corpus->num_files;
+        result->bytes = corpus->total_bytes;
+    } else if (modifies) {
+        snprintf(archive, sizeof(archive), "%s/%s-%s-work.tar", opts->work_dir, corpus->name,
+                 tool);
+        if (copy_whole_file(corpus->base_archive, archive) != 0) {
+            result->failed = 1;
+            return;
+        }
+        struct stat stat_buf;
+        stat(archive, &stat_buf);
+        original_size = stat_buf.st_size;
+        num_args = corpus->num_subset;
+        result->num_files = corpus->num_subset;
+        result->bytes = corpus->subset_bytes;
+    } else {
+        snprintf(archive, sizeof(archive), "%s", corpus->base_archive);
+        result->num_files = corpus->num_files * corpus->versions;
+        result->bytes = corpus->total_bytes * corpus->versions;
+    }
+    if (is_extract) {
+        snprintf(extract_dir, sizeof(extract_dir), "%s/extract", opts->work_dir);
+        run_dir = extract_dir;
+    }
+
+    char **argv = build_argv(opts, tool, op, archive, corpus->files, num_args);
+    if (argv == NULL) {
+        result->failed = 1;
+        return;
+    }
+
+    // Warm runs are preceded by one untimed run to fill the cache
+    int total_runs = cold ? opts->runs : opts->runs + 1;
+    for (int run = 0; run < total_runs; run++) {
+        if (is_create) {
+            unlink(archive);
+        } else if (modifies && run > 0) {
+            restore_archive(archive, original_size);
+        }
+        if (strcmp(op, "update") == 0) {
+            touch_subset(corpus);
+        }
+        if (is_extract) {
+            remove_tree(extract_dir);
+            mkdir(extract_dir, 0755);
+        }
+        if (cold) {
+            drop_caches(corpus, archive);
+        }
+
+        double elapsed = run_command(run_dir, argv);
+        if (elapsed < 0) {
+            result->failed = 1;
+            break;
+        }
+        if (cold || run > 0) {
+            result->runs[result->num_runs++] = elapsed;
+        }
+    }
+    free(argv);
+
+    if (modifies) {
+        unlink(archive);
+    }
+    if (is_extract) {
+        remove_tree(extract_dir);
+    }
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static double median(const result_t *result) {
+    double sorted[MAX_RUNS];
+    memcpy(sorted, result->runs, result->num_runs * sizeof(double));
+    qsort(sorted, result->num_runs, sizeof(double), compare_doubles);
+    int mid = result->num_runs / 2;
+    return result->num_runs % 2 ? sorted[mid] : (sorted[mid - 1] + sorted[mid]) / 2;
+}
+
+static void print_table(void) {
+    printf("\n%-9s %-8s %-8s %-5s %10s %12s %12s\n", "corpus", "tool", "op", "cache",
+           "median_s", "MB/s", "files/s");
+    for (int i = 0; i < num_results; i++) {
+        const result_t *r = &results[i];
+        if (r->failed || r->num_runs == 0) {
+            printf("%-9s %-8s %-8s %-5s %10s\n", r->corpus, r->tool, r->op, r->cache, "FAILED");
+            continue;
+        }
+        double seconds = median(r);
+        printf("%-9s %-8s %-8s %-5s %10.4f %12.1f %12.0f\n", r->corpus, r->tool, r->op, r->cache,
+               seconds, r->bytes / seconds / 1e6, r->num_files / seconds);
+    }
+}
+
+/*
+ * Writes every result, including the individual run times, as JSON
+ * Returns 0 on success or -1 if an error occurs
+ */
+static int write_json(const options_t *opts) {
+    FILE *out = fopen(opts->output, "w");
+    if (out == NULL) {
+        perror(opts->output);
+        return -1;
+    }
+    struct utsname uts;
+    uname(&uts);
+    fprintf(out, "{\n");
+    fprintf(out, "    \"timestamp\": %ld,\n", (long) time(NULL));
+    fprintf(out, "    \"kernel\": \"%s %s\",\n", uts.sysname, uts.release);
+    fprintf(out, "    \"scale\": %g,\n", opts->scale);
+    fprintf(out, "    \"runs\": %d,\n", opts->runs);
+    fprintf(out, "    \"cold_method\": \"%s\",\n", cold_method);
+    fprintf(out, "    \"results\": [");
+    for (int i = 0; i < num_results; i++) {
+        const result_t *r = &results[i];
+        fprintf(out, "%s\n        {\"corpus\": \"%s\", \"tool\": \"%s\", \"op\": \"%s\", ",
+                i > 0 ? "," : "", r->corpus, r->tool, r->op);
+        fprintf(out, "\"cache\": \"%s\", \"files\": %d, \"bytes\": %lld, ", r->cache,
+                r->num_files, r->bytes);
+        if (r->failed || r->num_runs == 0) {
+            fprintf(out, "\"failed\": true}");
+            continue;
+        }
+        double seconds = median(r);
+        fprintf(out, "\"failed\": false, \"runs_s\": [");
+        for (int j = 0; j < r->num_runs; j++) {
+            fprintf(out, "%s%.6f", j > 0 ? ", " : "", r->runs[j]);
+        }
+        fprintf(out, "], \"median_s\": %.6f, \"mb_per_s\": %.3f, \"files_per_s\": %.1f}", seconds,
+                r->bytes / seconds / 1e6, r->num_files / seconds);
+    }
+    fprintf(out, "\n    ]\n}\n");
+    fclose(out);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [-s SCALE] [-r RUNS] [-o OUTPUT.json] [-w WORK_DIR] [-m MINITAR]\n", prog);
+    printf("          [-k CORPUS[,CORPUS...]] [--no-tar] [--no-cold]\n");
+    printf("  -s SCALE   shrink or grow every corpus (default 1.0: 100k tiny files,\n");
+    printf("             3 x 2 GiB files, 2000 mixed-size files, 50 files x 20 versions)\n");
+    printf("  -r RUNS    timed runs per measurement (default 3, at most %d)\n", MAX_RUNS);
+    printf("  -k LIST    only run the named corpora: tiny, large, mixed, versions\n");
+}
+
+int main(int argc, char **argv) {
+    options_t opts = {1.0, 3, 1, 1, "bench_results.json", NULL, "bench_work", "./minitar"};
+    static struct option long_options[] = {
+        {"no-tar", no_argument, NULL, 'T'},
+        {"no-cold", no_argument, NULL, 'C'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    const char *minitar = "./minitar";
+    const char *work_dir = "bench_work";
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:r:o:w:m:k:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 's':
+                opts.scale = atof(optarg);
+                break;
+            case 'r':
+                opts.runs = atoi(optarg);
+                break;
+            case 'o':
+                opts.output = optarg;
+                break;
+            case 'w':
+                work_dir = optarg;
+                break;
+            case 'm':
+                minitar = optarg;
+                break;
+            case 'k':
+                opts.only = optarg;
+                break;
+            case 'T':
+                opts.use_tar = 0;
+                break;
+            case 'C':
+                opts.use_cold = 0;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (opts.scale <= 0 || opts.runs < 1 || opts.runs > MAX_RUNS) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Commands run from inside the corpus directories, so paths must be absolute
+    mkdir(work_dir, 0755);
+    char resolved[PATH_MAX];
+    if (realpath(work_dir, resolved) == NULL || realpath(minitar, opts.minitar) == NULL) {
+        perror("Failed to resolve minitar or work directory");
+        return 1;
+    }
+    if (strlen(resolved) >= sizeof(opts.work_dir)) {
+        fprintf(stderr, "Work directory path is too long\n");
+        return 1;
+    }
+    strcpy(opts.work_dir, resolved);
+    if (opts.use_tar && system("tar --version > /dev/null 2>&1") != 0) {
+        printf("GNU tar not found, measuring minitar only\n");
+        opts.use_tar = 0;
+    }
+
+    const char *ops[] = {"create", "append", "list", "update", "extract"};
+    const char *tools[] = {"minitar", "tar"};
+    for (int c = 0; c < NUM_CORPORA; c++) {
+        corpus_t *corpus = &corpora[c];
+        if (opts.only != NULL && strstr(opts.only, corpus->name) == NULL) {
+            continue;
+        }
+        if (generate_corpus(corpus, &opts) != 0) {
+            return 1;
+        }
+        printf("Measuring corpus '%s' (%d files, %.1f MB)...\n", corpus->name, corpus->num_files,
+               corpus->total_bytes / 1e6);
+        fflush(stdout);
+        for (int o = 0; o < sizeof(ops) / sizeof(ops[0]); o++) {
+            for (int t = 0; t < (opts.use_tar ? 2 : 1); t++) {
+                measure(&opts, corpus, tools[t], ops[o], 0);
+                if (opts.use_cold) {
+                    measure(&opts, corpus, tools[t], ops[o], 1);
+                }
+            }
+        }
+    }
+
+    print_table();
+    if (write_json(&opts) != 0) {
+        return 1;
+    }
+    printf("\nResults written to %s\n", opts.output);
+    return 0;
+}
@@ -1,12 +1,67 @@
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
+#include "archive_diff.h"
+#include "archive_edit.h"
+#include "archive_io.h"
+#include "archive_search.h"
+#include "archive_server.h"
 #include "file_list.h"
 #include "minitar.h"
+#include "minitar_stats.h"
+
+static void print_usage(const char *program) {
+    printf("Usage: %s -c|a|t|u|x|d|A|--delete|--search PATTERN [-O] [--low-cache]\n"
+           "       [--rate-limit BYTES/s] [--ionice CLASS] [--sync none|data|full]\n"
+           "       [--stats[=json]] -f ARCHIVE [FILE...]\n"
+           "       %s --connect SOCKET -t|--stat|-x -O -f ARCHIVE [FILE...]\n"
+           "       %s --serve SOCKET\n",
+           program, program, program);
+}
+
+/*
+ * Returns 1 if 'arg' is an option whose value is the argument after it,
+ * 0 otherwise
+ */
+static int takes_value(const char *arg) {
+    const char *options[] = {"-f", "--rate-limit", "--ionice", "--sync", "--connect", "--search"};
+    for (int i = 0; i < sizeof(options) / sizeof(options[0]); i++) {
+        if (strcmp(arg, options[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Returns the value given to the long option 'name' at argv[i], written either
+ * as "NAME=VALUE" or as "NAME VALUE", or NULL if argv[i] is not that option.
+ * A missing value is returned as an empty string
+ */
+static const char *option_value(int argc, char **argv, int i, const char *name) {
+    size_t len = strlen(name);
+    if (strncmp(argv[i], name, len) != 0) {
+        return NULL;
+    }
+    if (argv[i][len] == '=') {
+        return argv[i] + len + 1;
+    }
+    if (argv[i][len] == '\0') {
+        return i + 1 < argc ? argv[i + 1] : "";
+    }
+    return NULL;
+}
 
 int main(int argc, char **argv) {
+    // a server keeps running until it is signalled and needs no archive
+    const char *serve_path = argc > 1 ? option_value(argc, argv, 1, "--serve") : NULL;
+    if (serve_path != NULL) {
+        return run_archive_server(serve_path) == 0 ? 0 : 1;
+    }
+
     if (argc < 4) {
-        printf("Usage: %s -c|a|t|u|x -f ARCHIVE [FILE...]\n", argv[0]);
+        print_usage(argv[0]);
         return 0;
     }
 
@@ -18,17 +73,88 @@ int main(int argc, char **argv) {
 
     char operation = '\0';
     char *archive_name = NULL;
+    int to_stdout = 0;
+    int stats_json = 0;
+    const char *server_path = NULL;
+    const char *pattern = NULL;
+    io_options_t io_options = {0};
     int i;
 
     // search through argc for valid operation
     for (i = 1; i < argc; i++) {
         if (argv[i][0] == '-' && strlen(argv[i]) == 2) {
             char flag = argv[i][1];
-            if (flag == 'c' || flag == 'a' || flag == 't' || flag == 'u' || flag == 'x') {
+            if (flag == 'c' || flag == 'a' || flag == 't' || flag == 'u' || flag == 'x' ||
+                flag == 'd' || flag == 'A') {
                 operation = flag;
                 break;
             }
         }
+        if (strcmp(argv[i], "--delete") == 0) {
+            operation = 'D';
+            break;
+        }
+        if (strcmp(argv[i], "--stat") == 0) {
+            operation = 'S';
+            break;
+        }
+        pattern = option_value(argc, argv, i, "--search");
+        if (pattern != NULL) {
+            operation = 'g';
+            break;
+        }
+    }
+
+    // check whether extracted files should go to stdout instead of new files
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-O") == 0) {
+            to_stdout = 1;
+            break;
+        }
+    }
+
+    // check whether requests should go to a running server
+    for (i = 1; i < argc; i++) {
+        const char *path = option_value(argc, argv, i, "--connect");
+        if (path != NULL) {
+            server_path = path;
+        }
+    }
+
+    // check whether archiving should stay out of the page cache, be throttled,
+    // run at a lower I/O priority or sync what it writes
+    for (i = 1; i < argc; i++) {
+        const char *rate = option_value(argc, argv, i, "--rate-limit");
+        const char *io_class = option_value(argc, argv, i, "--ionice");
+        const char *sync_level = option_value(argc, argv, i, "--sync");
+        if (strcmp(argv[i], "--low-cache") == 0) {
+            io_options.low_cache = 1;
+        } else if (rate != NULL && parse_rate(rate, &io_options.rate_limit) != 0) {
+            printf("Error: Invalid rate limit '%s'\n", rate);
+            file_list_clear(&files);
+            return 1;
+        } else if (io_class != NULL && set_io_priority(io_class) != 0) {
+            printf("Error: Invalid I/O class '%s', expected idle or best-effort[:0-7]\n",
+                   io_class);
+            file_list_clear(&files);
+            return 1;
+        } else if (sync_level != NULL &&
+                   parse_durability(sync_level, &io_options.durability) != 0) {
+            printf("Error: Invalid durability level '%s', expected none, data or full\n",
+                   sync_level);
+            file_list_clear(&files);
+            return 1;
+        }
+    }
+    set_io_options(&io_options);
+
+    // check whether to report timings and I/O counts when the run finishes
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--stats") == 0 || strcmp(argv[i], "--stats=json") == 0) {
+            stats_json = strcmp(argv[i], "--stats=json") == 0;
+            stats_enable();
+            break;
+        }
     }
 
     // find the archive file name
@@ -41,15 +167,17 @@ int main(int argc, char **argv) {
 
     // check for correct format
     if (operation == '\0' || archive_name == NULL) {
-        printf("Usage: %s -c|a|t|u|x -f ARCHIVE [FILE...]\n", argv[0]);
+        print_usage(argv[0]);
         file_list_clear(&files);
         return 1;
     }
 
     // collect file arguments for operations that need them
-    if (operation == 'c' || operation == 'a' || operation == 'u') {
+    if (operation == 'c' || operation == 'a' || operation == 'u' || operation == 'd' ||
+        operation == 'D' || operation == 'A' || operation == 'S' || operation == 'g' ||
+        (operation == 'x' && to_stdout)) {
         for (i = 1; i < argc; i++) {
-            if ((argv[i][0] == '-') ||(i > 0 && strcmp(argv[i-1], "-f") == 0)) {
+            if ((argv[i][0] == '-') || takes_value(argv[i - 1])) {
                 continue;
             }
 
@@ -62,8 +190,34 @@ int main(int argc, char **argv) {
     }
 
     int result = 0;
+    // Set by operations that report failure in the exit status. -d and
+    // --search follow diff(1) and grep(1): 0 or 1 for the outcome, 2 on error
+    int exit_status = 0;
 
-    if (operation == 'c') {
+    if (server_path != NULL) {
+        if (operation == 't') {
+            result = archive_server_request(server_path, REQUEST_LIST, archive_name, NULL,
+                                            STDOUT_FILENO);
+        } else if (operation == 'S' || (operation == 'x' && to_stdout)) {
+            archive_request_t request = operation == 'S' ? REQUEST_STAT : REQUEST_READ;
+            node_t *current = files.head;
+            if (current == NULL) {
+                printf("Error: --stat and -O require the name of a file\n");
+                result = -1;
+            }
+            while (current != NULL && result == 0) {
+                result = archive_server_request(server_path, request, archive_name, current->name,
+                                                STDOUT_FILENO);
+                current = current->next;
+            }
+        } else {
+            printf("Error: --connect only supports -t, --stat and -x -O\n");
+            result = -1;
+        }
+    } else if (operation == 'S') {
+        printf("Error: --stat requires --connect\n");
+        result = -1;
+    } else if (operation == 'c') {
         result = create_archive(archive_name, &files);
     } else if (operation == 'a') {
         result = append_files_to_archive(archive_name, &files);
@@ -96,6 +250,29 @@ int main(int argc, char **argv) {
             file_list_clear(&archive_files);
             result = append_files_to_archive(archive_name, &files);
         }
+    } else if (operation == 'A') {
+        result = concatenate_archives(archive_name, &files);
+        exit_status = result == 0 ? 0 : 1;
+    } else if (operation == 'D') {
+        result = delete_files_from_archive(archive_name, &files);
+    } else if (operation == 'g') {
+        int num_matches;
+        result = search_archive(archive_name, pattern, &files, &num_matches);
+        exit_status = result != 0 ? 2 : num_matches == 0;
+    } else if (operation == 'd') {
+        int num_differences;
+        result = diff_archive(archive_name, &files, &num_differences);
+        exit_status = result != 0 ? 2 : num_differences > 0;
+    } else if (operation == 'x' && to_stdout) {
+        if (files.head == NULL) {
+            printf("Error: -O requires the name of a file to extract\n");
+            result = -1;
+        }
+        node_t *current = files.head;
+        while (current != NULL && result == 0) {
+            result = extract_file_to_fd(archive_name, current->name, STDOUT_FILENO);
+            current = current->next;
+        }
     } else if (operation == 'x') {
         result = extract_files_from_archive(archive_name);
     } else {
@@ -103,7 +280,9 @@ int main(int argc, char **argv) {
         result = -1;
     }
 
+    stats_report(stats_json);
+
     // clean up memory
     file_list_clear(&files);
-    return 0;
+    return exit_status;
 }
@@ -0,0 +1,247 @@
+#include "minitar_stats.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "minitar.h"
+
+// Member latencies are bucketed by powers of two microseconds
+#define NUM_LATENCY_BUCKETS 32
+
+// Kernel I/O accounting for this process, from /proc/self/io
+typedef struct {
+    long long rchar;
+    long long wchar;
+    long long syscr;
+    long long syscw;
+    long long read_bytes;
+    long long write_bytes;
+} proc_io_t;
+
+static struct {
+    int enabled;
+    double start_time;
+    double phase_seconds[NUM_PHASES];
+    long long phase_calls[NUM_PHASES];
+    long long bytes_read;
+    long long bytes_written;
+    long long blocks_read;
+    long long blocks_written;
+    long long headers_parsed;
+    long long members;
+    long long latency_buckets[NUM_LATENCY_BUCKETS];
+    double max_latency;
+    int have_start_io;
+    proc_io_t start_io;
+} stats;
+
+static const char *phase_names[NUM_PHASES] = {
+    "stat", "nss_lookup", "source_read", "archive_write", "header_scan", "archive_read",
+    "output_write",
+};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Reads this process's I/O counters from /proc/self/io
+ * Returns 0 on success or -1 if they are unavailable
+ */
+static int read_proc_io(proc_io_t *io) {
+    FILE *file = fopen("/proc/self/io", "r");
+    if (file == NULL) {
+        return -1;
+    }
+    memset(io, 0, sizeof(*io));
+    char key[32];
+    long long value;
+    while (fscanf(file, "%31[^:]: %lld\n", key, &value) == 2) {
+        if (strcmp(key, "rchar") == 0) {
+            io->rchar = value;
+        } else if (strcmp(key, "wchar") == 0) {
+            io->wchar = value;
+        } else if (strcmp(key, "syscr") == 0) {
+            io->syscr = value;
+        } else if (strcmp(key, "syscw") == 0) {
+            io->syscw = value;
+        } else if (strcmp(key, "read_bytes") == 0) {
+            io->read_bytes = value;
+        } else if (strcmp(key, "write_bytes") == 0) {
+            io->write_bytes = value;
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+void stats_enable(void) {
+    memset(&stats, 0, sizeof(stats));
+    stats.enabled = 1;
+    stats.start_time = now();
+    stats.have_start_io = read_proc_io(&stats.start_io) == 0;
+}
+
+int stats_enabled(void) {
+    return stats.enabled;
+}
+
+double stats_begin(void) {
+    return stats.enabled ? now() : 0;
+}
+
+void stats_end(stats_phase_t phase, double start) {
+    if (stats.enabled) {
+        stats.phase_seconds[phase] += now() - start;
+        stats.phase_calls[phase]++;
+    }
+}
+
+void stats_count_read(size_t bytes) {
+    if (stats.enabled) {
+        stats.bytes_read += bytes;
+        stats.blocks_read += (bytes + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    }
+}
+
+void stats_count_write(size_t bytes) {
+    if (stats.enabled) {
+        stats.bytes_written += bytes;
+        stats.blocks_written += (bytes + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    }
+}
+
+void stats_count_header(void) {
+    if (stats.enabled) {
+        stats.headers_parsed++;
+    }
+}
+
+void stats_member_done(double start) {
+    if (!stats.enabled) {
+        return;
+    }
+    double elapsed = now() - start;
+    long long micros = (long long) (elapsed * 1e6);
+    int bucket = 0;
+    while (bucket < NUM_LATENCY_BUCKETS - 1 && (1LL << (bucket + 1)) <= micros) {
+        bucket++;
+    }
+    stats.latency_buckets[bucket]++;
+    stats.members++;
+    if (elapsed > stats.max_latency) {
+        stats.max_latency = elapsed;
+    }
+}
+
+/*
+ * Finds the upper bound, in microseconds, of the latency bucket containing
+ * the given fraction of all members
+ */
+static long long latency_percentile(double fraction) {
+    long long target = (long long) (fraction * stats.members);
+    long long seen = 0;
+    for (int i = 0; i < NUM_LATENCY_BUCKETS; i++) {
+        seen += stats.latency_buckets[i];
+        if (seen > target) {
+            return 1LL << (i + 1);
+        }
+    }
+    return 1LL << NUM_LATENCY_BUCKETS;
+}
+
+static void report_text(double wall, const proc_io_t *io, const struct rusage *usage) {
+    fprintf(stderr, "== minitar stats ==\n");
+    fprintf(stderr, "wall time:      %.6f s (user %.6f s, sys %.6f s)\n", wall,
+            usage->ru_utime.tv_sec + usage->ru_utime.tv_usec / 1e6,
+            usage->ru_stime.tv_sec + usage->ru_stime.tv_usec / 1e6);
+    for (int i = 0; i < NUM_PHASES; i++) {
+        if (stats.phase_calls[i] > 0) {
+            fprintf(stderr, "  %-14s %12.6f s %5.1f%% %10lld calls\n", phase_names[i],
+                    stats.phase_seconds[i], wall > 0 ? 100 * stats.phase_seconds[i] / wall : 0,
+                    stats.phase_calls[i]);
+        }
+    }
+    fprintf(stderr, "data read:      %lld bytes (%lld blocks)\n", stats.bytes_read,
+            stats.blocks_read);
+    fprintf(stderr, "data written:   %lld bytes (%lld blocks)\n", stats.bytes_written,
+            stats.blocks_written);
+    fprintf(stderr, "headers parsed: %lld\n", stats.headers_parsed);
+    if (io != NULL) {
+        fprintf(stderr, "syscalls:       %lld read, %lld write\n", io->syscr, io->syscw);
+        fprintf(stderr, "storage I/O:    %lld bytes read, %lld bytes written\n", io->read_bytes,
+                io->write_bytes);
+    }
+    if (stats.members > 0) {
+        fprintf(stderr, "members:        %lld (p50 < %lld us, p99 < %lld us, max %.0f us)\n",
+                stats.members, latency_percentile(0.5), latency_percentile(0.99),
+                stats.max_latency * 1e6);
+        for (int i = 0; i < NUM_LATENCY_BUCKETS; i++) {
+            if (stats.latency_buckets[i] > 0) {
+                fprintf(stderr, "  < %10lld us %10lld\n", 1LL << (i + 1), stats.latency_buckets[i]);
+            }
+        }
+    }
+}
+
+static void report_json(double wall, const proc_io_t *io, const struct rusage *usage) {
+    fprintf(stderr, "{\"wall_s\": %.6f, \"user_s\": %.6f, \"sys_s\": %.6f, \"phases\": {", wall,
+            usage->ru_utime.tv_sec + usage->ru_utime.tv_usec / 1e6,
+            usage->ru_stime.tv_sec + usage->ru_stime.tv_usec / 1e6);
+    for (int i = 0; i < NUM_PHASES; i++) {
+        fprintf(stderr, "%s\"%s\": {\"seconds\": %.6f, \"calls\": %lld}", i > 0 ? ", " : "",
+                phase_names[i], stats.phase_seconds[i], stats.phase_calls[i]);
+    }
+    fprintf(stderr, "}, \"bytes_read\": %lld, \"bytes_written\": %lld, ", stats.bytes_read,
+            stats.bytes_written);
+    fprintf(stderr, "\"blocks_read\": %lld, \"blocks_written\": %lld, \"headers_parsed\": %lld, ",
+            stats.blocks_read, stats.blocks_written, stats.headers_parsed);
+    if (io != NULL) {
+        fprintf(stderr, "\"syscalls\": {\"read\": %lld, \"write\": %lld}, ", io->syscr, io->syscw);
+        fprintf(stderr, "\"storage_bytes\": {\"read\": %lld, \"written\": %lld}, ", io->read_bytes,
+                io->write_bytes);
+    }
+    fprintf(stderr, "\"members\": %lld, \"member_latency_us\": {\"max\": %.0f, \"buckets\": [",
+            stats.members, stats.max_latency * 1e6);
+    int first = 1;
+    for (int i = 0; i < NUM_LATENCY_BUCKETS; i++) {
+        if (stats.latency_buckets[i] > 0) {
+            fprintf(stderr, "%s{\"lt\": %lld, \"count\": %lld}", first ? "" : ", ", 1LL << (i + 1),
+                    stats.latency_buckets[i]);
+            first = 0;
+        }
+    }
+    fprintf(stderr, "]}}\n");
+}
+
+void stats_report(int json) {
+    if (!stats.enabled) {
+        return;
+    }
+    double wall = now() - stats.start_time;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    // Counters are reported relative to when collection started
+    proc_io_t end_io;
+    proc_io_t *io = NULL;
+    if (stats.have_start_io && read_proc_io(&end_io) == 0) {
+        end_io.rchar -= stats.start_io.rchar;
+        end_io.wchar -= stats.start_io.wchar;
+        end_io.syscr -= stats.start_io.syscr;
+        end_io.syscw -= stats.start_io.syscw;
+        end_io.read_bytes -= stats.start_io.read_bytes;
+        end_io.write_bytes -= stats.start_io.write_bytes;
+        io = &end_io;
+    }
+
+    if (json) {
+        report_json(wall, io, &usage);
+    } else {
+        report_text(wall, io, &usage);
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef _MINITAR_STATS_H
+#define _MINITAR_STATS_H
+
+#include <stddef.h>
+
+// Phases of work that minitar operations spend their time in
+typedef enum {
+    // stat() of a file being archived
+    PHASE_STAT,
+    // Owner and group name lookups through NSS (getpwuid(), getgrgid())
+    PHASE_NSS_LOOKUP,
+    // Reading the contents of files being archived
+    PHASE_SOURCE_READ,
+    // Writing headers and data blocks to an archive
+    PHASE_ARCHIVE_WRITE,
+    // Reading and parsing header blocks of an existing archive
+    PHASE_HEADER_SCAN,
+    // Reading member data out of an existing archive: the read() side of
+    // extraction when sendfile() can't be used, and the member comparisons
+    // of -d
+    PHASE_ARCHIVE_READ,
+    // Writing extracted data to files or stdout, including sendfile() copies
+    // straight from the archive
+    PHASE_OUTPUT_WRITE,
+    NUM_PHASES
+} stats_phase_t;
+
+// Turn on collection. Until this is called every other function is a no-op,
+// so uninstrumented runs pay no clock or counter overhead
+void stats_enable(void);
+
+// Returns 1 if statistics are being collected, 0 otherwise
+int stats_enabled(void);
+
+// Start timing a phase; pass the result to stats_end()
+double stats_begin(void);
+
+// Add the time since 'start' to 'phase'
+void stats_end(stats_phase_t phase, double start);
+
+// Count bytes moved to or from an archive or member file
+void stats_count_read(size_t bytes);
+void stats_count_write(size_t bytes);
+
+// Count one header block parsed from an archive
+void stats_count_header(void);
+
+// Record the total time spent on one archive member, measured from 'start'
+void stats_member_done(double start);
+
+// Print everything collected to stderr, as JSON if 'json' is nonzero
+void stats_report(int json);
+
+#endif    // _MINITAR_STATS_H